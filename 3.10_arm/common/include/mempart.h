@@ -47,6 +47,130 @@ typedef struct rol_mem_part{
     long          part[1];	/* pointer to memory pool (defined as 4 bytes for 32bit systems and 8 bytes for 64 bit systems) */
 } ROL_MEM_PART;
 
+/*
+  Waiting for a list to fill (listWait)
+
+  listWait spins for LIST_SPIN_COUNT CPU pauses, then sleeps, re-checking
+  the list every LIST_WAIT_NSEC.  listAdd is unchanged: it does not wake
+  the waiter, so a sleeping listWait finds a new node up to LIST_WAIT_NSEC
+  (1 ms by default) late.
+
+  LIST_WAIT_FUTEX (Linux only): listWait sleeps on the list count (futex)
+  and listAdd wakes it.  Every listAdd in the source file then pays a
+  memory barrier and a check of listWaiters, the number of listWait
+  callers sleeping.  That count is per source file, not per list: DALIST
+  is also used by prebuilt code (libpart, the ROC), so its layout cannot
+  change.  A listAdd compiled in another file, or in that prebuilt code,
+  never wakes the waiter, which is then still up to LIST_WAIT_NSEC late.
+  Define it only where the same file fills and waits on the list.
+*/
+#ifndef LIST_SPIN_COUNT
+#define LIST_SPIN_COUNT  2000      /* CPU pauses before listWait sleeps */
+#endif
+#ifndef LIST_WAIT_NSEC
+#define LIST_WAIT_NSEC   1000000   /* longest listWait sleep between checks (ns) */
+#endif
+
+#ifdef VXWORKS
+
+static inline void
+listWaitBlock(DALIST *li)
+{
+  while((*(volatile int *)&(li)->c == 0) && (*(volatile int *)&(li)->to == 0))
+    ;
+}
+
+#define listWake(li)
+#define listWakeAll(li)
+
+#else /* !VXWORKS */
+
+#include <limits.h>
+#include <time.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define listCpuRelax()  __asm__ __volatile__("pause" ::: "memory")
+#elif defined(__aarch64__) || (defined(__ARM_ARCH) && (__ARM_ARCH >= 7))
+#define listCpuRelax()  __asm__ __volatile__("yield" ::: "memory")
+#else
+#define listCpuRelax()  __sync_synchronize()
+#endif
+
+#if defined(__linux__) && defined(LIST_WAIT_FUTEX)
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static volatile int listWaiters = 0;  /* listWait callers sleeping (this file) */
+
+static inline void
+listWaitBlock(DALIST *li)
+{
+  volatile int *c = (volatile int *)&(li)->c, *to = (volatile int *)&(li)->to;
+  struct timespec ts;
+  int ispin;
+
+  for(ispin = 0; ispin < LIST_SPIN_COUNT; ispin++)
+    {
+      if((*c != 0) || (*to != 0))
+	return;
+      listCpuRelax();
+    }
+
+  __sync_fetch_and_add(&listWaiters, 1);
+  while((*c == 0) && (*to == 0))
+    {
+      ts.tv_sec  = 0;
+      ts.tv_nsec = LIST_WAIT_NSEC;
+      /* returns immediately if the count is no longer 0 */
+      syscall(SYS_futex, &(li)->c, FUTEX_WAIT_PRIVATE, 0, &ts, NULL, 0);
+    }
+  __sync_fetch_and_sub(&listWaiters, 1);
+}
+
+static inline void
+listWakeN(DALIST *li, int n)
+{
+  __sync_synchronize(); /* count update before the listWaiters check */
+  if(listWaiters)
+    syscall(SYS_futex, &(li)->c, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+#define listWake(li)     listWakeN((li), 1)
+#define listWakeAll(li)  listWakeN((li), INT_MAX)
+
+#else /* !LIST_WAIT_FUTEX */
+
+static inline void
+listWaitBlock(DALIST *li)
+{
+  volatile int *c = (volatile int *)&(li)->c, *to = (volatile int *)&(li)->to;
+  struct timespec ts;
+  int ispin;
+
+  for(ispin = 0; ispin < LIST_SPIN_COUNT; ispin++)
+    {
+      if((*c != 0) || (*to != 0))
+	return;
+      listCpuRelax();
+    }
+
+  while((*c == 0) && (*to == 0))
+    {
+      ts.tv_sec  = 0;
+      ts.tv_nsec = LIST_WAIT_NSEC;
+      nanosleep(&ts, NULL);
+    }
+}
+
+#define listWake(li)
+#define listWakeAll(li)
+
+#endif /* LIST_WAIT_FUTEX */
+
+#endif /* VXWORKS */
+
 #define listInit(li) {bzero((char *) (li), sizeof(DALIST));}
 
 #define listGet(li,no) {\
@@ -62,8 +186,7 @@ typedef struct rol_mem_part{
 }
 
 #define listWait(li,no) {(no) = 0;(li)->to = 0; \
-                         while(((li)->c == 0) && ((li)->to == 0)) { \
-                                             }; \
+                         listWaitBlock((li)); \
                          if ((li)->to == 0) { \
                                               (li)->c--; \
                                               (no) = (li)->f; \
@@ -78,8 +201,12 @@ typedef struct rol_mem_part{
 /* call add_cmd (if it exists) whenever a buffer is added to a list */
 #define listAdd(li,no) {if(! (li)->c ){(li)->f = (li)->l = (no);(no)->p = 0;} else \
 			  {(no)->p = (li)->l;(li)->l->n = (no);(li)->l = (no);} (no)->n = 0;(li)->c++;\
+			  listWake((li)); \
 		          if((li)->add_cmd != NULL) (*((li)->add_cmd)) ((li));  }
 
+/* stop a listWait on (li) - it returns (no) = -1 */
+#define listTimeout(li) {(li)->to = 1; listWakeAll((li));}
+
 #define listSnip(li,no) {if ((no)->p) {(no)->p->n =(no)->n;} else {(li)->f = (no)->n;} \
 if ((no)->n) {(no)->n->p =(no)->p;} else {(li)->l = (no)->p;} \
 (li)->c--;if ((li)->c==0) (li)->f = (li)->l = (DANODE *)0;(no)->p=(no)->n= (DANODE *)0;}
@@ -0,0 +1,279 @@
+/*****************************************************************************
+ *
+ * BankBuilder.hxx - CODA bank builder for readout lists compiled as C++
+ *
+ *  Scoped replacement for the CBOPEN/CBCLOSE (BankTools.h) and
+ *  BANKOPEN/BANKCLOSE (dmaBankTools.h) macros.  A bank is opened by
+ *  declaring it, and closed (length and padding filled in) when it goes
+ *  out of scope.  The content type is taken from the template argument:
+ *
+ *    uint32_t  0x01    float     0x02    int16_t  0x04    uint16_t 0x05
+ *    int8_t    0x06    uint8_t   0x07    double   0x08    int64_t  0x09
+ *    uint64_t  0x0a    int32_t   0x0b    bank_t   0x10    segment_t 0x20
+ *
+ *  Any other type is a compile error.
+ *
+ * Usage:
+ *
+ *    #include "BankBuilder.hxx"
+ *
+ *    void rocTrigger(int arg)
+ *    {
+ *      codaBank::Buffer buf(dma_dabufp, codaBank::bufferEnd(the_event));
+ *
+ *      {
+ *        codaBank::Bank<uint32_t> ti(buf, 4, 0);
+ *        ti.advance(tiReadBlock(0, ti.data(), 8+2*blockLevel, 1));
+ *      }
+ *      {
+ *        codaBank::Bank<codaBank::segment_t> adc(buf, 3, 0);
+ *        codaBank::Segment<uint16_t> ch(buf, 1);
+ *        ch << 0x123 << 0x456;
+ *      }
+ *    }
+ *
+ *  Banks of bank_t or segment_t hold other banks (segments), which are
+ *  declared in nested scopes.  They write through the Buffer's pointer
+ *  (dma_dabufp, or rol->dabufp), so it may still be used directly
+ *  between them.  Banks of data are written with add(), << or data()
+ *  and advance().  The buffer pointer is moved past them when they close.
+ *
+ *  The Buffer's end (bufferEnd()) is checked on every write, unless
+ *  NDEBUG is defined.  Writing past it prints an error and aborts.
+ *  The checks cost up to ~25% over the macros (bankBuilderBench), so
+ *  build production readout lists with -DNDEBUG for the cost of the
+ *  macros.
+ */
+
+#ifndef __BANKBUILDER_HXX__
+#define __BANKBUILDER_HXX__
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace codaBank
+{
+
+  /* Content types of banks that hold banks, or segments */
+  struct bank_t {};
+  struct segment_t {};
+
+  /* Content type code for each payload type.  Not defined for
+     unsupported types. */
+  template <typename T> struct ContentType;
+
+  template <> struct ContentType<uint32_t>  { enum { code = 0x01, container = 0 }; };
+  template <> struct ContentType<float>     { enum { code = 0x02, container = 0 }; };
+  template <> struct ContentType<int16_t>   { enum { code = 0x04, container = 0 }; };
+  template <> struct ContentType<uint16_t>  { enum { code = 0x05, container = 0 }; };
+  template <> struct ContentType<int8_t>    { enum { code = 0x06, container = 0 }; };
+  template <> struct ContentType<uint8_t>   { enum { code = 0x07, container = 0 }; };
+  template <> struct ContentType<double>    { enum { code = 0x08, container = 0 }; };
+  template <> struct ContentType<int64_t>   { enum { code = 0x09, container = 0 }; };
+  template <> struct ContentType<uint64_t>  { enum { code = 0x0a, container = 0 }; };
+  template <> struct ContentType<int32_t>   { enum { code = 0x0b, container = 0 }; };
+  template <> struct ContentType<bank_t>    { enum { code = 0x10, container = 1 }; };
+  template <> struct ContentType<segment_t> { enum { code = 0x20, container = 1 }; };
+
+  /* Compile time check (C++98) */
+  template <bool> struct StaticCheck;
+  template <> struct StaticCheck<true> {};
+
+  /*
+    Write position in an event buffer.  Refers to the readout list's
+    buffer pointer (dma_dabufp or rol->dabufp), so that it moves as banks
+    are written.  end = 0 turns off the bounds check.
+  */
+  class Buffer
+  {
+  public:
+    Buffer(unsigned int *&dabufp, const void *end = 0)
+      : bufp(dabufp), end((const char *) end) {}
+
+    /* Check that nbytes may be written at p */
+    inline void check(const void *p, size_t nbytes) const
+    {
+#ifndef NDEBUG
+      if(end && (((const char *) p + nbytes) > end))
+	overflow(p, nbytes);
+#endif
+    }
+
+    unsigned int *&bufp;
+    const char *end;
+
+  private:
+    void overflow(const void *p, size_t nbytes) const
+    {
+      printf("%s: ERROR: bank write of %d bytes at %p is past end of buffer (%p)\n",
+	     __func__, (int) nbytes, p, (const void *) end);
+      abort();
+    }
+  };
+
+#ifdef __DMAPLIST__
+  /* End of a dmaPList (vmeIN) event buffer */
+  inline const void *
+  bufferEnd(const DMANODE *node)
+  {
+    return (const char *) node + node->part->size;
+  }
+#endif
+
+#ifdef __MEM_PART__
+  /* End of a ROC pool event buffer */
+  inline const void *
+  bufferEnd(const DANODE *node)
+  {
+    return (const char *) node + node->part->size;
+  }
+#endif
+
+  /*
+    Common part of Bank and Segment: the payload, and padding the end of
+    the payload to a 32 bit word.  HDR is the number of header words.
+  */
+  template <typename T, int HDR>
+  class Scope
+  {
+  public:
+    /* Add one value */
+    inline void add(T value)
+    {
+      StaticCheck<!ContentType<T>::container>();
+      buf_.check(q_, sizeof(T));
+      memcpy(q_, &value, sizeof(T));	/* unaligned 64 bit types are fine */
+      q_++;
+    }
+
+    /* Add n values */
+    inline void add(const T *values, int n)
+    {
+      StaticCheck<!ContentType<T>::container>();
+      buf_.check(q_, n * sizeof(T));
+      memcpy(q_, values, n * sizeof(T));
+      q_ += n;
+    }
+
+    inline Scope &operator<<(T value)
+    {
+      add(value);
+      return *this;
+    }
+
+    /* Next free payload address, e.g. for a DMA or block read.  Follow
+       with advance() */
+    inline T *data()
+    {
+      StaticCheck<!ContentType<T>::container>();
+      return q_;
+    }
+
+    /* Count n values written at data() */
+    inline void advance(int n)
+    {
+      buf_.check(q_, n * sizeof(T));
+      q_ += n;
+    }
+
+  protected:
+    Scope(Buffer &buf)
+      : buf_(buf), start_(buf.bufp)
+    {
+      buf_.check(start_, HDR * sizeof(unsigned int));
+      buf_.bufp += HDR;
+      q_ = (T *) buf_.bufp;
+    }
+
+    /* Pad the payload to a word, and move the buffer pointer past it.
+       Returns the length in words, excluding the first header word, and
+       the number of pad bytes. */
+    inline unsigned int finish(unsigned int &pad)
+    {
+      if(ContentType<T>::container)
+	{
+	  pad = 0;
+	}
+      else
+	{
+	  char *p = (char *) q_;
+
+	  pad = (unsigned int) (-(long) (p - (char *) &start_[HDR])) & 3;
+	  buf_.check(p, pad);
+	  for(unsigned int ipad = 0; ipad < pad; ipad++)
+	    p[ipad] = 0;
+	  buf_.bufp = (unsigned int *) (p + pad);
+	}
+
+      return (unsigned int) (buf_.bufp - start_) - 1;
+    }
+
+    Buffer &buf_;
+    unsigned int *start_;	/* first header word */
+    T *q_;			/* next payload value */
+
+  private:
+    Scope(const Scope &);
+    Scope &operator=(const Scope &);
+  };
+
+  /*
+    Bank: two word header
+      length (words, excluding this one)
+      tag<<16 | pad<<14 | type<<8 | num
+    CEOPEN's sync flag is the top 4 bits of the tag.
+  */
+  template <typename T>
+  class Bank : public Scope<T, 2>
+  {
+  public:
+    Bank(Buffer &buf, unsigned int tag, unsigned int num = 0)
+      : Scope<T, 2>(buf)
+    {
+      this->start_[1] = ((tag & 0xffff) << 16) | (ContentType<T>::code << 8) | (num & 0xff);
+    }
+
+    ~Bank()
+    {
+      unsigned int pad;
+
+      this->start_[0]  = this->finish(pad);
+      this->start_[1] |= pad << 14;
+    }
+  };
+
+  /*
+    Segment: one word header
+      tag<<24 | pad<<22 | type<<16 | length (words, excluding this one)
+  */
+  template <typename T>
+  class Segment : public Scope<T, 1>
+  {
+  public:
+    Segment(Buffer &buf, unsigned int tag)
+      : Scope<T, 1>(buf)
+    {
+      this->start_[0] = ((tag & 0xff) << 24) | ((ContentType<T>::code & 0x3f) << 16);
+    }
+
+    ~Segment()
+    {
+      unsigned int pad, len;
+
+      len = this->finish(pad);
+#ifndef NDEBUG
+      if(len > 0xffff)
+	{
+	  printf("%s: ERROR: segment length %d > 0xffff words\n", __func__, len);
+	  abort();
+	}
+#endif
+      this->start_[0] |= (pad << 22) | len;
+    }
+  };
+
+} /* namespace codaBank */
+
+#endif /* __BANKBUILDER_HXX__ */
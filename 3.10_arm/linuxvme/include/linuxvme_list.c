@@ -39,6 +39,7 @@
 #include "jvme.h"
 #include <LINUXVME_source.h>
 #include "dmaBankTools.h"
+#include "rolTransTimer.h"
 #ifdef TIR_SOURCE
 #include "tirLib.h"
 #elif defined(TS_SOURCE)
@@ -89,6 +90,8 @@ static void __download()
 {
   int status;
 
+  rolTimerStart("Download");
+
   daLogMsg("INFO","Readout list compiled %s", DAYTIME);
 #ifdef POLLING___
   rol->poll = 1;
@@ -98,6 +101,7 @@ static void __download()
   bigendian_out=1;
 
   /* Initialize memory partition library */
+  rolTimerBegin("dmaPCreate");
   dmaPartInit();
 
   /* Setup Buffer memory to store events */
@@ -110,25 +114,33 @@ static void __download()
 
   /* Reinitialize the Buffer memory */
   dmaPReInitAll();
+  rolTimerEnd();
 
   /* Initialize VME Interrupt interface - use defaults */
+  rolTimerBegin("trigInit");
 #ifdef TIR_SOURCE
   tirIntInit(TIR_ADDR,TIR_MODE,1);
 #endif
 #ifdef TS_SOURCE
   tsInit(TS_ADDR,0);
 #endif
+  rolTimerEnd();
 
   /* Execute User defined download */
+  rolTimerBegin("rocDownload");
   rocDownload();
+  rolTimerEnd();
 
   daLogMsg("INFO","Download Executed");
 
+  rolTimerReport();
+
 
 } /*end download */
 
 static void __prestart()
 {
+  rolTimerStart("Prestart");
   CTRIGINIT;
   *(rol->nevents) = 0;
   unsigned long jj, adc_id;
@@ -142,7 +154,9 @@ static void __prestart()
   vmeCheckMutexHealth(10);
 
   /* Execute User defined prestart */
+  rolTimerBegin("rocPrestart");
   rocPrestart();
+  rolTimerEnd();
 
   /* Initialize VME Interrupt variables */
 #ifdef TIR_SOURCE
@@ -158,6 +172,8 @@ static void __prestart()
 
   daLogMsg("INFO","Prestart Executed");
 
+  rolTimerReport();
+
   if (__the_event__) WRITE_EVENT_;
   *(rol->nevents) = 0;
   rol->recNb = 0;
@@ -170,6 +186,8 @@ static void __end()
   DMANODE *outEvent;
   int oldnumber;
 
+  rolTimerStart("End");
+
   /* Disable Interrupts */
 #ifdef TIR_SOURCE
   tirIntDisable();
@@ -182,7 +200,9 @@ static void __end()
 #endif
 
   /* Execute User defined end */
+  rolTimerBegin("rocEnd");
   rocEnd();
+  rolTimerEnd();
 
   CDODISABLE(LINUXVME,1,0);
 
@@ -209,6 +229,8 @@ static void __end()
 
   daLogMsg("INFO","End Executed");
 
+  rolTimerReport();
+
   if (__the_event__) WRITE_EVENT_;
 } /* end end block */
 
@@ -222,12 +244,16 @@ static void __pause()
 
 static void __go()
 {
+  rolTimerStart("Go");
+
   daLogMsg("INFO","Entering Go");
 
   errCount=0;
 
   CDOENABLE(LINUXVME,1,1);
+  rolTimerBegin("rocGo");
   rocGo();
+  rolTimerEnd();
 
 #ifdef TIR_SOURCE
   tirIntEnable(TIR_CLEAR_COUNT);
@@ -236,6 +262,8 @@ static void __go()
   tsGo(1);
 #endif
 
+  rolTimerReport();
+
   if (__the_event__) WRITE_EVENT_;
 }
 
@@ -186,22 +186,17 @@ void INIT_NAME(rolp, cmd)
 	    rolp->inited = -1;
 	    break;
 	  }
-
-	  strcpy(name, rolp->listName);
-	  strcat(name, ":dispQ");
-	  rolp->dispQ = partCreate(name, 0, 0, 0);
-	  if (rolp->dispQ == 0) {
-	    rolp->inited = -1;
-	    break;
-	  }
+	  /* Pending triggers are queued per source (trigger_dispatch.h),
+	     not on rolp->dispQ */
+	  dispReset();
 
 	  rolp->inited = 1;
 	  printf("Init - Done\n");
 	  break;
 	}
       case DA_FREE_PROC:
+	 dispReset();
 	 partFree (rolp->dispatch);
-	 partFree (rolp->dispQ);
 	 partFree (rolp->pool);
 	 rolp->inited = 0;
 	break;
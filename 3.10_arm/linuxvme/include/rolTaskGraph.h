@@ -0,0 +1,432 @@
+/*****************************************************************************
+ *
+ * rolTaskGraph.h - Parallel configuration steps for readout list transitions
+ *
+ *  Most of the time spent in rocDownload/rocPrestart is waiting on board
+ *  level delays (taskDelay, firmware ready loops), not on bus traffic.
+ *  Independent steps may be declared with their dependencies and run on
+ *  a pool of worker threads.
+ *
+ * Usage:
+ *
+ *    #include "tiprimary_list.c"
+ *    #include "rolTaskGraph.h"
+ *
+ *    static int faStep(void *arg) { faInit(...); return OK; }
+ *    static int f1Step(void *arg) { f1Init(...); return OK; }
+ *    static int faCfg(void *arg)  { fadc250Config(...); return OK; }
+ *
+ *    void rocDownload()
+ *    {
+ *      int fa, f1, cfg;
+ *
+ *      rolTaskInit();
+ *      fa  = rolTaskAdd("faInit", faStep, NULL, 0);
+ *      f1  = rolTaskAdd("f1Init", f1Step, NULL, 0);
+ *      cfg = rolTaskAdd("faConfig", faCfg, NULL, ROL_TASK_EXCLUSIVE);
+ *      rolTaskDepends(cfg, fa);
+ *
+ *      if(rolTaskRun(4) != 0)
+ *        daLogMsg("ERROR","Download configuration failed");
+ *    }
+ *
+ *  Steps flagged with ROL_TASK_EXCLUSIVE run while holding a mutex private
+ *  to this file, and are therefore serialized with each other.  Steps that
+ *  call libraries that are not thread safe should be flagged, or made
+ *  dependent on each other.  vmeBusLock() is not used for this: it is not
+ *  recursive, and the module libraries take it themselves, so a step
+ *  holding it would deadlock on its first bus access.
+ *
+ *  A step returning ERROR marks it as failed, and any step that depends on
+ *  it is skipped.
+ *
+ *  rolTaskRun(1), rolTaskRun(0), or setting the ROL_TASK_SERIAL environment
+ *  variable runs the steps on the calling thread in declaration order
+ *  (respecting dependencies).
+ *
+ *  Step timing is printed after each run.  Each step is also a phase in
+ *  the transition report of rolTransTimer.h, and phases the step opens
+ *  itself (rolTimerBegin/rolTimerEnd, on the worker thread) are nested
+ *  inside it.
+ *
+ *****************************************************************************/
+#ifndef __ROL_TASK_GRAPH__
+#define __ROL_TASK_GRAPH__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "jvme.h"
+#include "rolTransTimer.h"
+
+#define ROL_TASK_MAX        64   /* Maximum number of steps per run */
+#define ROL_TASK_MAX_DEPS    8   /* Maximum number of dependencies per step */
+#define ROL_TASK_MAX_THREADS 16  /* Maximum number of worker threads */
+
+/* Step flags */
+#define ROL_TASK_EXCLUSIVE (1<<0) /* Run serialized with the other flagged steps */
+
+/* Step states */
+#define ROL_TASK_WAITING  0
+#define ROL_TASK_RUNNING  1
+#define ROL_TASK_DONE     2
+#define ROL_TASK_FAILED   3
+#define ROL_TASK_SKIPPED  4
+
+typedef int (*ROL_TASK_FUNC)(void *arg);
+
+typedef struct
+{
+  char          name[ROLT_NAME_LEN]; /* step name */
+  ROL_TASK_FUNC func;                /* routine to execute */
+  void         *arg;                 /* argument passed to func */
+  int           flags;               /* ROL_TASK_* flags */
+  int           ndeps;               /* number of dependencies */
+  int           deps[ROL_TASK_MAX_DEPS]; /* steps that must be DONE first */
+  int           state;               /* ROL_TASK_WAITING, ... */
+  int           rval;                /* return value of func */
+  int           worker;              /* worker thread that ran the step */
+  double        start;               /* ms since start of transition */
+  double        elapsed;             /* ms */
+} ROL_TASK;
+
+static ROL_TASK rolTask[ROL_TASK_MAX];
+static int rolNTask = 0;
+static int rolTaskRemaining = 0, rolTaskRunning = 0;
+static int rolTaskParent = -1;  /* transition phase the steps nest in */
+
+static pthread_mutex_t rolTask_mutex     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  rolTask_cv        = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t rolTaskExcl_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define ROLTASKLOCK   if(pthread_mutex_lock(&rolTask_mutex)<0) perror("pthread_mutex_lock");
+#define ROLTASKUNLOCK if(pthread_mutex_unlock(&rolTask_mutex)<0) perror("pthread_mutex_unlock");
+
+/*
+  Clear all steps.  Call before declaring the steps of a transition.
+*/
+static void
+rolTaskInit()
+{
+  ROLTASKLOCK;
+  memset((char *)rolTask, 0, sizeof(rolTask));
+  rolNTask = 0;
+  rolTaskRemaining = 0;
+  rolTaskRunning = 0;
+  ROLTASKUNLOCK;
+}
+
+/*
+  Declare a step.
+
+  @param name  Name of the step (used in the timing report)
+  @param func  Routine to execute.  Returns ERROR on failure.
+  @param arg   Argument passed to func
+  @param flags ROL_TASK_EXCLUSIVE, or 0
+
+  @return Step id, if successful. ERROR, otherwise.
+*/
+static int
+rolTaskAdd(const char *name, ROL_TASK_FUNC func, void *arg, int flags)
+{
+  int itask;
+
+  if(func == NULL)
+    {
+      printf("%s: ERROR: NULL routine for step %s\n", __func__, name);
+      return ERROR;
+    }
+
+  ROLTASKLOCK;
+  if(rolNTask >= ROL_TASK_MAX)
+    {
+      ROLTASKUNLOCK;
+      printf("%s: ERROR: Too many steps (%d).  %s not added.\n",
+	     __func__, ROL_TASK_MAX, name);
+      return ERROR;
+    }
+
+  itask = rolNTask++;
+  strncpy(rolTask[itask].name, name, ROLT_NAME_LEN-1);
+  rolTask[itask].name[ROLT_NAME_LEN-1] = 0;
+  rolTask[itask].func   = func;
+  rolTask[itask].arg    = arg;
+  rolTask[itask].flags  = flags;
+  rolTask[itask].ndeps  = 0;
+  rolTask[itask].state  = ROL_TASK_WAITING;
+  ROLTASKUNLOCK;
+
+  return itask;
+}
+
+/*
+  Declare that step itask may only run after step idep has completed.
+
+  @return OK if successful, ERROR otherwise.
+*/
+static int
+rolTaskDepends(int itask, int idep)
+{
+  int rval = OK;
+
+  ROLTASKLOCK;
+  if((itask < 0) || (itask >= rolNTask) || (idep < 0) || (idep >= rolNTask)
+     || (itask == idep))
+    {
+      printf("%s: ERROR: Invalid step (%d) or dependency (%d)\n",
+	     __func__, itask, idep);
+      rval = ERROR;
+    }
+  else if(rolTask[itask].ndeps >= ROL_TASK_MAX_DEPS)
+    {
+      printf("%s: ERROR: Too many dependencies for step %s\n",
+	     __func__, rolTask[itask].name);
+      rval = ERROR;
+    }
+  else
+    {
+      rolTask[itask].deps[rolTask[itask].ndeps++] = idep;
+    }
+  ROLTASKUNLOCK;
+
+  return rval;
+}
+
+/*
+  Find the first step that is ready to run.  Steps depending on a failed
+  or skipped step are marked as skipped.  Must be called with
+  rolTask_mutex held.
+
+  @return Index of the step, or -1 if none are ready.
+*/
+static int
+rolTaskNext()
+{
+  int itask, idep, ready, dstate;
+
+  for(itask = 0; itask < rolNTask; itask++)
+    {
+      if(rolTask[itask].state != ROL_TASK_WAITING)
+	continue;
+
+      ready = 1;
+      for(idep = 0; idep < rolTask[itask].ndeps; idep++)
+	{
+	  dstate = rolTask[rolTask[itask].deps[idep]].state;
+	  if((dstate == ROL_TASK_FAILED) || (dstate == ROL_TASK_SKIPPED))
+	    {
+	      rolTask[itask].state = ROL_TASK_SKIPPED;
+	      rolTaskRemaining--;
+	      ready = 0;
+	      /* Earlier steps may depend on this one. Start over. */
+	      itask = -1;
+	      break;
+	    }
+	  if(dstate != ROL_TASK_DONE)
+	    ready = 0;
+	}
+
+      if(ready)
+	{
+	  rolTask[itask].state = ROL_TASK_RUNNING;
+	  rolTaskRunning++;
+	  return itask;
+	}
+    }
+
+  /* Nothing ready and nothing running: the rest can never run */
+  if((rolTaskRunning == 0) && (rolTaskRemaining > 0))
+    {
+      printf("%s: ERROR: Circular dependency.  Skipping remaining steps.\n",
+	     __func__);
+      for(itask = 0; itask < rolNTask; itask++)
+	{
+	  if(rolTask[itask].state == ROL_TASK_WAITING)
+	    rolTask[itask].state = ROL_TASK_SKIPPED;
+	}
+      rolTaskRemaining = 0;
+    }
+
+  return -1;
+}
+
+/*
+  Execute a step.  Called without rolTask_mutex held.
+*/
+static void
+rolTaskExec(int itask, int worker)
+{
+  ROL_TASK *task = &rolTask[itask];
+  int rval, parent = rolTParent, depth = rolTDepth;
+  double start;
+
+  if(task->flags & ROL_TASK_EXCLUSIVE)
+    pthread_mutex_lock(&rolTaskExcl_mutex);
+
+  /* The step is a transition phase, nested in the phase rolTaskRun was
+     called from, and the phases it opens nest inside it */
+  rolTParent = rolTaskParent;
+  rolTimerBegin(task->name);
+
+  start = rolTimerNow();
+  rval = (*task->func)(task->arg);
+
+  while(rolTDepth > depth)
+    rolTimerEnd();
+  rolTParent = parent;
+
+  if(task->flags & ROL_TASK_EXCLUSIVE)
+    pthread_mutex_unlock(&rolTaskExcl_mutex);
+
+  ROLTASKLOCK;
+  task->start   = start;
+  task->elapsed = rolTimerNow() - start;
+  task->rval    = rval;
+  task->worker  = worker;
+  task->state   = (rval == ERROR) ? ROL_TASK_FAILED : ROL_TASK_DONE;
+  rolTaskRunning--;
+  rolTaskRemaining--;
+  if(pthread_cond_broadcast(&rolTask_cv)<0)
+    perror("pthread_cond_broadcast");
+  ROLTASKUNLOCK;
+}
+
+static void *
+rolTaskWorker(void *arg)
+{
+  int worker = (int)(long)arg;
+  int itask;
+
+  ROLTASKLOCK;
+  while(rolTaskRemaining > 0)
+    {
+      itask = rolTaskNext();
+      if(itask < 0)
+	{
+	  if(rolTaskRemaining > 0)
+	    if(pthread_cond_wait(&rolTask_cv, &rolTask_mutex)<0)
+	      perror("pthread_cond_wait");
+	  continue;
+	}
+
+      ROLTASKUNLOCK;
+      rolTaskExec(itask, worker);
+      ROLTASKLOCK;
+    }
+  if(pthread_cond_broadcast(&rolTask_cv)<0)
+    perror("pthread_cond_broadcast");
+  ROLTASKUNLOCK;
+
+  return NULL;
+}
+
+/*
+  Print the step timing.
+*/
+static void
+rolTaskReport(double start, double wall)
+{
+  static const char *stateName[5] =
+    {"waiting", "running", "done", "FAILED", "SKIPPED"};
+  double sum = 0;
+  int itask;
+
+  printf("%s: %d steps  wall %9.1f ms\n", __func__, rolNTask, wall);
+  printf("  Step                         worker     start(ms)   elapsed(ms)  state\n");
+  printf("  ---------------------------  ------  ------------  ------------  -------\n");
+  for(itask = 0; itask < rolNTask; itask++)
+    {
+      if(rolTask[itask].state == ROL_TASK_SKIPPED)
+	{
+	  printf("  %-27s  %6s  %12s  %12s  %s\n",
+		 rolTask[itask].name, "-", "-", "-",
+		 stateName[rolTask[itask].state]);
+	  continue;
+	}
+      printf("  %-27s  %6d  %12.1f  %12.1f  %s\n",
+	     rolTask[itask].name, rolTask[itask].worker,
+	     rolTask[itask].start - start, rolTask[itask].elapsed,
+	     stateName[rolTask[itask].state]);
+      sum += rolTask[itask].elapsed;
+    }
+  if(wall > 0)
+    printf("  sum of steps %9.1f ms  (x%.2f)\n", sum, sum/wall);
+}
+
+/*
+  Run all declared steps.
+
+  @param nthreads Number of worker threads.  0 or 1 runs the steps
+                  serially, in declaration order, on the calling thread.
+
+  @return Number of steps that failed or were skipped (0 on success)
+*/
+static int
+rolTaskRun(int nthreads)
+{
+  pthread_t workers[ROL_TASK_MAX_THREADS];
+  int iworker, itask, nbad = 0;
+  double start;
+
+  if(nthreads > ROL_TASK_MAX_THREADS)
+    nthreads = ROL_TASK_MAX_THREADS;
+  if(nthreads > rolNTask)
+    nthreads = rolNTask;
+  if(getenv("ROL_TASK_SERIAL") != NULL)
+    nthreads = 1;
+
+  ROLTASKLOCK;
+  for(itask = 0; itask < rolNTask; itask++)
+    rolTask[itask].state = ROL_TASK_WAITING;
+  rolTaskRemaining = rolNTask;
+  rolTaskRunning = 0;
+  rolTaskParent = (rolTDepth > 0) ? rolTStack[rolTDepth-1] : rolTParent;
+  ROLTASKUNLOCK;
+
+  start = rolTimerNow();
+
+  if(nthreads <= 1)
+    {
+      /* Deterministic serial execution */
+      ROLTASKLOCK;
+      while((itask = rolTaskNext()) >= 0)
+	{
+	  ROLTASKUNLOCK;
+	  rolTaskExec(itask, 0);
+	  ROLTASKLOCK;
+	}
+      ROLTASKUNLOCK;
+    }
+  else
+    {
+      for(iworker = 0; iworker < nthreads; iworker++)
+	{
+	  if(pthread_create(&workers[iworker], NULL, rolTaskWorker,
+			    (void *)(long)iworker) != 0)
+	    {
+	      perror("pthread_create");
+	      break;
+	    }
+	}
+
+      if(iworker == 0)
+	{
+	  /* No workers.  Do it ourselves. */
+	  rolTaskWorker((void *)0);
+	}
+
+      while(iworker-- > 0)
+	pthread_join(workers[iworker], NULL);
+    }
+
+  rolTaskReport(start, rolTimerNow() - start);
+
+  for(itask = 0; itask < rolNTask; itask++)
+    if(rolTask[itask].state != ROL_TASK_DONE)
+      nbad++;
+
+  return nbad;
+}
+
+#endif /* __ROL_TASK_GRAPH__ */
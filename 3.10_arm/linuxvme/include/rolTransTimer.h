@@ -0,0 +1,235 @@
+/*****************************************************************************
+ *
+ * rolTransTimer.h - Transition timing for the "Primary" readout lists
+ *
+ *  The primary readout lists (tiprimary_list.c, tsprimary_list.c,
+ *  linuxvme_list.c) time every phase of their transitions with these
+ *  routines.  User code called from a transition (rocDownload,
+ *  rocPrestart, ...) may add its own sub-phases:
+ *
+ *    void rocDownload()
+ *    {
+ *      rolTimerBegin("faInit");
+ *      faInit(FADC_ADDR, FADC_INCR, NFADC, iflag);
+ *      rolTimerEnd();
+ *      ...
+ *    }
+ *
+ *  Phases nest per thread: rolTimerEnd closes the phase most recently
+ *  opened by the same thread.  Steps run by rolTaskGraph.h may time
+ *  their own sub-phases from its worker threads; each step is a phase,
+ *  and its sub-phases nest inside it.  Another thread's outermost phases
+ *  are top level phases, unless it sets rolTParent first.
+ *
+ *  At the end of each transition, rolTimerReport() prints the phase
+ *  table, sends a one line summary with daLogMsg, and appends the same
+ *  line (with time and run number) to a history file.  The history file
+ *  is taken from the ROL_TIMING_FILE environment variable, or defaults to
+ *  /tmp/<rol name>_transitions.log.  Set ROL_TIMING_FILE to "none" to
+ *  disable the history file.
+ *
+ *****************************************************************************/
+#ifndef __ROL_TRANS_TIMER__
+#define __ROL_TRANS_TIMER__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+extern void daLogMsg(char *severity, char *fmt,...);
+
+#define ROLT_MAX_PHASES   64   /* Maximum number of phases per transition */
+#define ROLT_MAX_DEPTH     8   /* Maximum nesting of rolTimerBegin */
+#define ROLT_NAME_LEN     32
+
+typedef struct
+{
+  char   name[ROLT_NAME_LEN];  /* phase name */
+  int    depth;                /* nesting depth (0 = transition phase) */
+  int    parent;               /* enclosing phase, or -1 */
+  double start;                /* ms since rolTimerStart */
+  double elapsed;              /* ms, < 0 while the phase is still open */
+} ROLT_PHASE;
+
+static ROLT_PHASE rolTPhase[ROLT_MAX_PHASES];
+static int rolTNPhase = 0;
+static __thread int rolTDepth = 0, rolTStack[ROLT_MAX_DEPTH]; /* this thread's open phases */
+static __thread int rolTParent = -1;  /* phase this thread's outermost phases nest in */
+static char rolTTransition[ROLT_NAME_LEN];
+static struct timespec rolTZero;
+static pthread_mutex_t rolT_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define ROLTLOCK   if(pthread_mutex_lock(&rolT_mutex)<0) perror("pthread_mutex_lock");
+#define ROLTUNLOCK if(pthread_mutex_unlock(&rolT_mutex)<0) perror("pthread_mutex_unlock");
+
+/* Milliseconds since the start of the current transition */
+static double
+rolTimerNow()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double)(now.tv_sec - rolTZero.tv_sec)*1.e3 +
+    (double)(now.tv_nsec - rolTZero.tv_nsec)*1.e-6;
+}
+
+/*
+  Start timing a new transition.  Clears phases from the previous one.
+*/
+static void
+rolTimerStart(const char *transition)
+{
+  ROLTLOCK;
+  clock_gettime(CLOCK_MONOTONIC, &rolTZero);
+  strncpy(rolTTransition, transition, ROLT_NAME_LEN-1);
+  rolTTransition[ROLT_NAME_LEN-1] = 0;
+  rolTNPhase = 0;
+  rolTDepth = 0;
+  ROLTUNLOCK;
+}
+
+/*
+  Open a phase (nested inside the phase this thread has open, if any).
+
+  Returns the phase index, or -1 if the phase table or nesting is full.
+*/
+static int
+rolTimerBegin(const char *name)
+{
+  int iphase, parent;
+
+  ROLTLOCK;
+  if((rolTNPhase >= ROLT_MAX_PHASES) || (rolTDepth >= ROLT_MAX_DEPTH))
+    {
+      ROLTUNLOCK;
+      printf("%s: WARN: Too many phases in %s.  %s not timed.\n",
+	     __func__, rolTTransition, name);
+      return -1;
+    }
+
+  parent = (rolTDepth > 0) ? rolTStack[rolTDepth-1] : rolTParent;
+  if(parent >= rolTNPhase)  /* from a previous transition */
+    parent = -1;
+
+  iphase = rolTNPhase++;
+  strncpy(rolTPhase[iphase].name, name, ROLT_NAME_LEN-1);
+  rolTPhase[iphase].name[ROLT_NAME_LEN-1] = 0;
+  rolTPhase[iphase].parent  = parent;
+  rolTPhase[iphase].depth   = (parent < 0) ? 0 : rolTPhase[parent].depth + 1;
+  rolTPhase[iphase].elapsed = -1;
+  rolTStack[rolTDepth++] = iphase;
+  rolTPhase[iphase].start   = rolTimerNow();
+  ROLTUNLOCK;
+
+  return iphase;
+}
+
+/*
+  Close the phase most recently opened by this thread.
+*/
+static void
+rolTimerEnd()
+{
+  double now = rolTimerNow();
+  int iphase;
+
+  ROLTLOCK;
+  if(rolTDepth > 0)
+    {
+      iphase = rolTStack[--rolTDepth];
+      rolTPhase[iphase].elapsed = now - rolTPhase[iphase].start;
+    }
+  ROLTUNLOCK;
+}
+
+/* Print a phase, then the phases nested in it.  Adds them to summary. */
+static int
+rolTimerPrint(int iphase, char *summary, int size, int len)
+{
+  int ichild;
+
+  printf("  %*s%-*s %9.1f ms  (start %9.1f)\n",
+	 2*rolTPhase[iphase].depth, "",
+	 ROLT_NAME_LEN - 2*rolTPhase[iphase].depth, rolTPhase[iphase].name,
+	 rolTPhase[iphase].elapsed, rolTPhase[iphase].start);
+
+  if(len < size)
+    len += snprintf(summary + len, size - len, " %s=%.1f",
+		    rolTPhase[iphase].name, rolTPhase[iphase].elapsed);
+
+  for(ichild = iphase + 1; ichild < rolTNPhase; ichild++)
+    {
+      if(rolTPhase[ichild].parent == iphase)
+	len = rolTimerPrint(ichild, summary, size, len);
+    }
+
+  return len;
+}
+
+/*
+  Report the phases of the current transition.  Phases that were never
+  closed (by any thread) are closed here.
+*/
+static void
+rolTimerReport()
+{
+  double total;
+  char summary[1024];
+  int iphase, len;
+  char *fname, defname[128];
+  FILE *fout;
+
+  total = rolTimerNow();
+
+  ROLTLOCK;
+  rolTDepth = 0;
+  for(iphase = 0; iphase < rolTNPhase; iphase++)
+    {
+      if(rolTPhase[iphase].elapsed < 0)
+	rolTPhase[iphase].elapsed = total - rolTPhase[iphase].start;
+    }
+
+  printf("%s: %s  total %9.1f ms\n", __func__, rolTTransition, total);
+
+  len = snprintf(summary, sizeof(summary), "%s timing (ms): total=%.1f",
+		 rolTTransition, total);
+
+  for(iphase = 0; iphase < rolTNPhase; iphase++)
+    {
+      if(rolTPhase[iphase].parent < 0)
+	len = rolTimerPrint(iphase, summary, (int)sizeof(summary), len);
+    }
+  ROLTUNLOCK;
+
+  daLogMsg("INFO", "%s", summary);
+
+  /* Append to the transition history */
+  fname = getenv("ROL_TIMING_FILE");
+  if(fname == NULL)
+    {
+      snprintf(defname, sizeof(defname), "/tmp/%s_transitions.log",
+	       rol->listName ? rol->listName : ROL_NAME__);
+      fname = defname;
+    }
+
+  if(strcmp(fname, "none") == 0)
+    return;
+
+  fout = fopen(fname, "a");
+  if(fout == NULL)
+    {
+      perror("fopen");
+      printf("%s: WARN: Unable to open transition history file %s\n",
+	     __func__, fname);
+      return;
+    }
+
+  fprintf(fout, "%ld run=%d roc=%d %s\n",
+	  (long)time(0), rol->runNumber, ROCID, summary);
+  fclose(fout);
+}
+
+#endif /* __ROL_TRANS_TIMER__ */
@@ -34,6 +34,54 @@
 #define MAX_EVENT_POOL   400
 #endif /* MAX_NUM_EVENTS */
 #endif /* MAX_EVENT_POOL */
+#ifndef DMA_QUEUE_MODE
+/* vmeIN/vmeOUT queue mode (dmaPSetQueueMode).  DMAP_QUEUE_SPSC takes the
+   partition mutex out of the asyncTrigger <-> usrtrig event hand-off */
+#define DMA_QUEUE_MODE DMAP_QUEUE_LIST
+#endif /* DMA_QUEUE_MODE */
+#ifndef EVENT_ALIGN
+/* Alignment (bytes) of the data of each vmeIN buffer (dmaPSetAlignment).
+   e.g. DMAP_ALIGN_CACHE_LINE starts each event on a cache line */
+#define EVENT_ALIGN DMAP_ALIGN_DEFAULT
+#endif /* EVENT_ALIGN */
+
+/* EVENT_POOL_BYTES: make vmeIN a packed partition (dmaPCreatePacked) of
+   this many bytes, instead of MAX_EVENT_POOL buffers of MAX_EVENT_LENGTH.
+   Each event then only keeps the space it uses. */
+
+#ifndef MAX_EVENT_BATCH
+/* Maximum number of vmeOUT events usrtrig writes to the ROC output per
+   call.  Fewer are taken if fewer are waiting.  1 = one event per call */
+#define MAX_EVENT_BATCH 1
+#endif /* MAX_EVENT_BATCH */
+
+/* EVENT_TRACE: stamp each event at each readout stage (dmaPTraceEnable)
+   from Prestart, and print the stage latencies at End.  Without it, the
+   stamps are not compiled in. */
+#ifdef EVENT_TRACE
+#define DMAP_TRACE
+#endif
+
+#ifdef ZERO_COPY_OUTPUT
+/* Zero-copy output: usrtrig hands each vmeOUT buffer to the ROC output
+   instead of copying the event.  ZC_HEADROOM words in front of the event
+   hold the node's own partition, the ROC node header and the bank header.
+   With 4 byte pointers they are rounded up so that the event itself stays
+   on EVENT_ALIGN.  With 8 byte pointers the ROC node must stay 8 byte
+   aligned, which puts the event 4 bytes past EVENT_ALIGN, as in a ROC
+   pool buffer (copy path). */
+#if defined(__SIZEOF_POINTER__) && (__SIZEOF_POINTER__ > 4)
+#define ZC_HEADROOM							\
+  ((((sizeof(ROL_MEM_PART) + offsetof(DANODE, data)) + EVENT_ALIGN - 1)	\
+    / EVENT_ALIGN) * (EVENT_ALIGN / sizeof(unsigned int)) + 1)
+#else
+#define ZC_HEADROOM							\
+  ((((sizeof(ROL_MEM_PART) + offsetof(DANODE, data) + sizeof(unsigned int)) \
+     + EVENT_ALIGN - 1) / EVENT_ALIGN) * (EVENT_ALIGN / sizeof(unsigned int)))
+#endif
+#else
+#define ZC_HEADROOM 0
+#endif /* ZERO_COPY_OUTPUT */
 
 /* POLLING_MODE */
 #define POLLING___
@@ -45,10 +93,12 @@
 #endif
 
 #include <stdio.h>
+#include <stddef.h>
 #include <rol.h>
 #include "jvme.h"
 #include <TIPRIMARY_source.h>
 #include "tiLib.h"
+#include "rolTransTimer.h"
 extern void daLogMsg(char *severity, char *fmt,...);
 extern int bigendian_out;
 
@@ -126,6 +176,113 @@ void asyncTrigger();
 /* Input and Output Partitions for VME Readout */
 DMA_MEM_ID vmeIN, vmeOUT;
 
+/* Trace stamps of the event usrtrig leaves for WRITE_EVENT_ (usrtrig_done) */
+static unsigned long long lastEventTstamp[DMAP_TRACE_NSTAGE];
+static int lastEventTraced = 0;
+
+/* ROC bank header for a vmeOUT event, as written by CEOPEN(ROCID, BT_BANK, blockLevel) */
+#define TIPRIMARY_BANK_HEADER(sync)					\
+  (((sync)<<28) | ((ROCID) << 16) | ((BT_BANK_ty) << 8) | (blockLevel))
+
+/*
+  Return vmeOUT event buffers to vmeIN.  Acknowledge the TI, or signal
+  the end of run, if waiting on it.
+*/
+static void
+tiprimaryFreeEvents(DMANODE **outEvents, int nevents)
+{
+  unsigned int blockstatus = 0;
+  int bready = 0;
+
+  ACKLOCK;
+
+  dmaPFreeItems(outEvents, nevents);
+
+  /* A packed vmeIN may still not have room for the next event */
+  if((tiNeedAck>0) && !dmaPEmpty(vmeIN))
+    {
+      tiNeedAck=0;
+      ACKSIGNAL;
+    }
+
+  if(ack_runend)
+    {
+      /* Check for available blocks in the TI */
+      blockstatus = tiBlockStatus(0,0);
+      bready = tiBReady();
+      printf("tiBlockStatus = 0x%x   tiBReady() = %d\n",
+	     blockstatus,bready);
+
+      if((blockstatus == 0) && (bready == 0))
+	ENDRUN_SIGNAL;
+    }
+
+  ACKUNLOCK;
+}
+
+#ifdef ZERO_COPY_OUTPUT
+/*
+  The ROC output node for a vmeOUT buffer is built at the end of its
+  headroom, so that the node's data[1] is the event's first word
+  (data[ZC_HEADROOM]).  With 4 byte pointers the node is then only 4 byte
+  aligned, which is all its members need.
+
+  Each node is owned by a partition of its own, at the start of the
+  headroom.  Once the ROC has shipped the event it frees the node
+  (partFreeItem: an unlocked listAdd, then free_cmd) onto that
+  partition's list, and zcFreeEvent returns the vmeOUT buffer to vmeIN.
+  Only the thread freeing the node touches the list, so the ROC output
+  threads and usrtrig never share one.
+*/
+#define ZC_OUTPART(dmaNode) ((ROL_MEM_ID)&(dmaNode)->data[0])
+#define ZC_OUTNODE(dmaNode)						\
+  ((DANODE *)((char *)&(dmaNode)->data[ZC_HEADROOM - 1] - offsetof(DANODE, data)))
+
+/* free_cmd of a node's partition: the ROC is done with the event */
+static void
+zcFreeEvent(DMANODE *outEvent)
+{
+  tiprimaryFreeEvents(&outEvent, 1);
+}
+
+/* Build the ROC output node for a vmeOUT event, in the event's headroom */
+static DANODE *
+zcOutputNode(DMANODE *outEvent, int nevent)
+{
+  ROL_MEM_ID outPart = ZC_OUTPART(outEvent);
+  DANODE *outNode = ZC_OUTNODE(outEvent);
+
+  memset((char *)outPart, 0, sizeof(ROL_MEM_PART));
+  outPart->free_cmd   = zcFreeEvent;
+  outPart->clientData = outEvent;
+
+  memset((char *)outNode, 0, offsetof(DANODE, length));
+  outNode->part   = outPart;
+  outNode->nevent = nevent;
+
+  /* What CEOPEN/CECLOSE would write */
+  outNode->length  = outEvent->length - ZC_HEADROOM + 1;
+  outNode->data[0] = TIPRIMARY_BANK_HEADER(outEvent->type);
+
+  return outNode;
+}
+#endif /* ZERO_COPY_OUTPUT */
+
+/* Copy a vmeOUT event into a ROC pool buffer, behind its bank header */
+static DANODE *
+copyOutputNode(DANODE *outNode, DMANODE *outEvent, int nevent)
+{
+  int len = outEvent->length - ZC_HEADROOM;
+
+  outNode->nevent  = nevent;
+  outNode->length  = len + 1;
+  outNode->data[0] = TIPRIMARY_BANK_HEADER(outEvent->type);
+  memcpy((char *)&outNode->data[1], (char *)&outEvent->data[ZC_HEADROOM],
+	 len*sizeof(unsigned int));
+
+  return outNode;
+}
+
 /**
  *  DOWNLOAD
  */
@@ -133,6 +290,8 @@ static void __download()
 {
   int status;
 
+  rolTimerStart("Download");
+
   daLogMsg("INFO","Readout list compiled %s", DAYTIME);
 #ifdef POLLING___
   rol->poll = 1;
@@ -146,19 +305,33 @@ static void __download()
   pthread_cond_init(&endrun_cv,NULL);
 
   /* Initialize memory partition library */
+  rolTimerBegin("dmaPCreate");
   dmaPartInit();
 
   /* Setup Buffer memory to store events */
   dmaPFreeAll();
-  vmeIN  = dmaPCreate("vmeIN",MAX_EVENT_LENGTH,MAX_EVENT_POOL,0);
+  dmaPSetAlignment(EVENT_ALIGN);
+#ifdef EVENT_POOL_BYTES
+  vmeIN  = dmaPCreatePacked("vmeIN",MAX_EVENT_LENGTH + ZC_HEADROOM*sizeof(unsigned int),
+			    EVENT_POOL_BYTES);
+#else
+  vmeIN  = dmaPCreate("vmeIN",MAX_EVENT_LENGTH + ZC_HEADROOM*sizeof(unsigned int),
+		      MAX_EVENT_POOL,0);
+#endif
   vmeOUT = dmaPCreate("vmeOUT",0,0,0);
+  dmaPSetAlignment(DMAP_ALIGN_DEFAULT);
 
   if(vmeIN == 0)
     daLogMsg("ERROR", "Unable to allocate memory for event buffers");
 
   /* Reinitialize the Buffer memory */
   dmaPReInitAll();
+#ifndef EVENT_POOL_BYTES
+  dmaPSetQueueMode(vmeIN, DMA_QUEUE_MODE, MAX_EVENT_POOL);
+#endif
+  dmaPSetQueueMode(vmeOUT, DMA_QUEUE_MODE, MAX_EVENT_POOL);
   dmaPStatsAll();
+  rolTimerEnd();
 
   /* Initialize Fiber Latency offset */
   tiSetFiberLatencyOffset_preInit(FIBER_LATENCY_OFFSET);
@@ -177,19 +350,25 @@ static void __download()
 #define TI_FLAG 0
 #endif
 
+  rolTimerBegin("tiInit");
   status = tiInit(TI_ADDR,TI_READOUT,TI_FLAG);
   if(status == -1) daLogMsg("ERROR","Unable to initialize TI board");
 
   /* Set timestamp format 48 bits */
   tiSetEventFormat(3);
+  rolTimerEnd();
 
   /* Execute User defined download */
+  rolTimerBegin("rocDownload");
   rocDownload();
+  rolTimerEnd();
 
   daLogMsg("INFO","Download Executed");
 
   tiDisableVXSSignals();
 
+  rolTimerReport();
+
 } /*end download */
 
 /**
@@ -197,6 +376,8 @@ static void __download()
  */
 static void __prestart()
 {
+  rolTimerStart("Prestart");
+
   ACKLOCK;
   ack_runend=0;
   ACKUNLOCK;
@@ -205,12 +386,18 @@ static void __prestart()
 
   daLogMsg("INFO","Entering Prestart");
 
+#ifdef EVENT_TRACE
+  dmaPTraceEnable(1);
+#endif
+  lastEventTraced = 0;
+
 
   TIPRIMARY_INIT;
   CTRIGRSS(TIPRIMARY,1,usrtrig,usrtrig_done);
   CRTTYPE(1,TIPRIMARY,1);
 
   /* If the TI Master, send a Clock and Trig Link Reset */
+  rolTimerBegin("tiLinkReset");
   if(tsCrate)
     {
       tiClockReset();
@@ -222,11 +409,15 @@ static void __prestart()
 
   /* Check the health of the vmeBus Mutex.. re-init if necessary */
   vmeCheckMutexHealth(10);
+  rolTimerEnd();
 
   /* Execute User defined prestart */
+  rolTimerBegin("rocPrestart");
   rocPrestart();
+  rolTimerEnd();
 
   /* If the TI Master, send a Sync Reset */
+  rolTimerBegin("tiSyncReset");
   if(tsCrate)
     {
       printf("%s: Sending sync as TI master\n",__FUNCTION__);
@@ -235,12 +426,15 @@ static void __prestart()
       taskDelay(2);
       tiSetBlockLevel(blockLevel);
     }
+  rolTimerEnd();
 
   /* Connect User Trigger Routine */
   tiIntConnect(TI_INT_VEC,asyncTrigger,0);
 
   daLogMsg("INFO","Prestart Executed");
 
+  rolTimerReport();
+
   if (__the_event__) WRITE_EVENT_;
   *(rol->nevents) = 0;
   rol->recNb = 0;
@@ -262,6 +456,8 @@ static void __pause()
  */
 static void __go()
 {
+  rolTimerStart("Go");
+
   daLogMsg("INFO","Entering Go");
   ACKLOCK;
   ack_runend=0;
@@ -271,10 +467,14 @@ static void __go()
   errCount=0;
 
   CDOENABLE(TIPRIMARY,1,1);
+  rolTimerBegin("rocGo");
   rocGo();
+  rolTimerEnd();
 
   tiIntEnable(1);
 
+  rolTimerReport();
+
   if (__the_event__) WRITE_EVENT_;
 }
 
@@ -282,6 +482,8 @@ static void __end()
 {
   unsigned int blockstatus=0;
 
+  rolTimerStart("End");
+
   /* Stop triggers on the TI-master */
   if(tsCrate)
     {
@@ -290,6 +492,7 @@ static void __end()
 
   blockstatus = tiBlockStatus(0,0);
 
+  rolTimerBegin("tiBlockDrain");
   ACKLOCK;
   ack_runend=1;
   if(blockstatus)
@@ -300,6 +503,7 @@ static void __end()
 	     __FUNCTION__,endrun_timedwait_ret,tiBlockStatus(0,0));
     }
   ACKUNLOCK;
+  rolTimerEnd();
 
   INTLOCK;
   INTUNLOCK;
@@ -308,84 +512,188 @@ static void __end()
   tiIntDisconnect();
 
   /* Execute User defined end */
+  rolTimerBegin("rocEnd");
   rocEnd();
+  rolTimerEnd();
 
   CDODISABLE(TIPRIMARY,1,0);
 
   dmaPStatsAll();
+  if(dmaPTraceFlag)
+    dmaPTraceStats();
 
   daLogMsg("INFO","End Executed");
 
+  rolTimerReport();
+
   if (__the_event__) WRITE_EVENT_;
 } /* end end block */
 
 void usrtrig(unsigned long EVTYPE,unsigned long EVSOURCE)
 {
-  int ii, len;
+  int ii, len, iev, nev, maxev, nbuf = 0, zc = 0;
   int syncFlag=0;
-  unsigned int event_number=0;
-  DMANODE *outEvent;
-  unsigned int blockstatus = 0;
-  int bready = 0;
+  DMANODE *outEvent, *outEvents[MAX_EVENT_BATCH];
+  DANODE *outNodes[MAX_EVENT_BATCH];
 
-  outEvent = dmaPGetItem(vmeOUT);
-  if(outEvent != NULL)
-    {
-      len = outEvent->length;
-      syncFlag = outEvent->type;
-      event_number = outEvent->nevent;
-
-      CEOPEN(ROCID, BT_BANK, blockLevel);
+#ifdef ZERO_COPY_OUTPUT
+  zc = (__the_event__ == (DANODE *) 0) && (rol->dabufp == NULL);
+#endif
 
-      if(rol->dabufp != NULL)
+  /* Take up to MAX_EVENT_BATCH of the events waiting in vmeOUT.
+     Copied events each need a ROC pool buffer (the last one is taken by
+     CEOPEN).  Take them now, under the same lock as the ROC's own pool
+     and output list operations. */
+  maxev = 1;
+  if(!__the_event__)
+    {
+      maxev = MAX_EVENT_BATCH;
+      if(!zc)
 	{
-	  for(ii=0;ii<len;ii++)
+	  LOCKINTS;
+	  if(maxev > rol->pool->list.c)
+	    maxev = rol->pool->list.c;
+	  while(nbuf < maxev - 1)
 	    {
-	      *rol->dabufp++ = outEvent->data[ii];
+	      partGetItem(rol->pool, outNodes[nbuf]);
+	      if(outNodes[nbuf] == 0)
+		break;
+	      nbuf++;
 	    }
+	  UNLOCKINTS;
+	  maxev = nbuf + 1;
 	}
-      else
+    }
+
+  nev = dmaPGetItems(vmeOUT, outEvents, maxev);
+
+  /* Return the pool buffers that are not needed */
+  if(nbuf > nev - 1)
+    {
+      LOCKINTS;
+      while(nbuf > ((nev > 0) ? nev - 1 : 0))
 	{
-	  printf("tiprimary_list: ERROR rol->dabufp is NULL -- Event lost\n");
+	  nbuf--;
+	  partFreeItem(outNodes[nbuf]);
 	}
+      UNLOCKINTS;
+    }
 
-      CECLOSE;
+  if(nev == 0)
+    {
+      logMsg("Error: no Event in vmeOUT queue\n",0,0,0,0,0,0);
+      return;
+    }
 
-      ACKLOCK;
+#ifdef EVENT_TRACE
+  if(dmaPTraceFlag)
+    {
+      for(iev = 0; iev < nev; iev++)
+	dmaPTraceStamp(outEvents[iev], DMAP_TRACE_USRTRIG);
+    }
+#endif
 
-      dmaPFreeItem(outEvent);
+  /* All but the last event go straight onto the ROC output, in order,
+     under one lock.
 
-      if(tiNeedAck>0)
+     They skip the rest of WRITE_EVENT_: the done routines are only called
+     for the last event.  That is safe because usrtrig_done only records
+     the last event's trace stamps (batched events are recorded below), and
+     the WRITE_EVENT_ that follows still sets poolEmpty/rol->doDone from
+     the pool count left after the whole batch.  A usrtrig_done that does
+     real work per event must be called for each batched event here. */
+  if(nev > 1)
+    {
+      for(iev = 0; iev < nev - 1; iev++)
 	{
-	  tiNeedAck=0;
-	  ACKSIGNAL;
+#ifdef ZERO_COPY_OUTPUT
+	  if(zc)
+	    outNodes[iev] = zcOutputNode(outEvents[iev], *(rol->nevents) + iev);
+	  else
+#endif
+	    outNodes[iev] = copyOutputNode(outNodes[iev], outEvents[iev],
+					   *(rol->nevents) + iev);
+
+#ifdef EVENT_TRACE
+	  /* Recorded now: a zero-copy buffer may be reused once it is queued */
+	  if(dmaPTraceFlag)
+	    {
+	      dmaPTraceStamp(outEvents[iev], DMAP_TRACE_WRITE);
+	      dmaPTraceRecord(dmaPTraceStamps(outEvents[iev]));
+	    }
+#endif
 	}
 
-      if(ack_runend)
+      LOCKINTS;
+      for(iev = 0; iev < nev - 1; iev++)
 	{
-	  /* Check for available blocks in the TI */
-	  blockstatus = tiBlockStatus(0,0);
-	  bready = tiBReady();
-	  printf("tiBlockStatus = 0x%x   tiBReady() = %d\n",
-		 blockstatus,bready);
-
-	  if((blockstatus == 0) && (bready == 0))
-	    ENDRUN_SIGNAL;
+	  if(rol->output)
+	    {
+	      listAdd(&(rol->output->list), outNodes[iev]);
+	    }
+	  else
+	    {
+	      partFreeItem(outNodes[iev]);
+	    }
 	}
+      *(rol->nevents) += nev - 1;
+      UNLOCKINTS;
+    }
+
+  /* The last event is written out (WRITE_EVENT_) after usrtrig returns */
+  outEvent = outEvents[nev - 1];
+  len = outEvent->length - ZC_HEADROOM;
+  syncFlag = outEvent->type;
+
+#ifdef EVENT_TRACE
+  lastEventTraced = dmaPTraceFlag;
+  if(lastEventTraced)
+    memcpy((char *)lastEventTstamp, (char *)dmaPTraceStamps(outEvent),
+	   sizeof(lastEventTstamp));
+#endif
+
+#ifdef ZERO_COPY_OUTPUT
+  if(zc)
+    {
+      /* vmeOUT buffers are returned to vmeIN by zcFreeEvent */
+      __the_event__ = zcOutputNode(outEvent, *(rol->nevents));
+      rol->dabufp   = &__the_event__->data[len + 1];
+      return;
+    }
+#endif
 
-      ACKUNLOCK;
+  CEOPEN(ROCID, BT_BANK, blockLevel);
+
+  if(rol->dabufp != NULL)
+    {
+      for(ii=0;ii<len;ii++)
+	{
+	  *rol->dabufp++ = outEvent->data[ZC_HEADROOM + ii];
+	}
     }
   else
     {
-      logMsg("Error: no Event in vmeOUT queue\n",0,0,0,0,0,0);
+      printf("tiprimary_list: ERROR rol->dabufp is NULL -- Event lost\n");
     }
 
+  CECLOSE;
+
+  tiprimaryFreeEvents(outEvents, nev);
 } /*end trigger */
 
 void asyncTrigger()
 {
   int intCount=0;
   int length,size;
+#ifdef EVENT_TRACE
+  unsigned long long triggerTime = 0;
+#endif
+
+#ifdef EVENT_TRACE
+  /* Called from tiPoll as soon as tiBReady() shows a block */
+  if(dmaPTraceFlag)
+    triggerTime = dmaPTraceTsc();
+#endif
 
   intCount = tiGetIntCount();
   syncFlag = tiGetSyncEventFlag();
@@ -400,6 +708,7 @@ void asyncTrigger()
       errCount++;
       return;
     }
+  dma_dabufp += ZC_HEADROOM; /* leave room for the zero-copy output header */
   if(the_event->length!=0)
     {
       printf("asyncTrigger: ERROR: Interrupt Count = %d the_event->length = %ld\t",intCount, the_event->length);
@@ -408,6 +717,12 @@ void asyncTrigger()
   /* Store Sync Flag status for this event */
   the_event->type = syncFlag;
 
+#ifdef EVENT_TRACE
+  if(dmaPTraceFlag)
+    dmaPTraceStamps(the_event)[DMAP_TRACE_TRIGGER] = triggerTime;
+  dmaPTraceStamp(the_event, DMAP_TRACE_READOUT);
+#endif
+
   /* Execute user defined Trigger Routine */
   rocTrigger(intCount);
 
@@ -448,6 +763,13 @@ void asyncTrigger()
 
 void usrtrig_done()
 {
+  /* Called from WRITE_EVENT_, once the event is on the ROC output */
+  if(lastEventTraced)
+    {
+      lastEventTstamp[DMAP_TRACE_WRITE] = dmaPTraceTsc();
+      dmaPTraceRecord(lastEventTstamp);
+      lastEventTraced = 0;
+    }
 } /*end done */
 
 void __done()
@@ -31,6 +31,18 @@ static unsigned int Tcode[MAXSRC];
 
 static DANODE *__the_event__, *input_event__, *__user_event__;
 
+/*
+   Pending triggers wait on the queue of their source.  dispReady has
+   bit (source) set while that queue is not empty, and each node's nevent
+   holds its arrival number, so the oldest trigger of any set of sources
+   is found by looking at their queue heads only.  The nodes belong to
+   rol->dispatch: the queues are emptied with dispReset when it is
+   created or freed (rol.h), and with dispFlush at Prestart.
+*/
+static DALIST dispSrcQ[MAXSRC];
+
+static unsigned int dispReady, dispSeq;
+
 pthread_mutex_t trigger_mutex=PTHREAD_MUTEX_INITIALIZER;
 
 /*
@@ -40,6 +52,7 @@ pthread_mutex_t trigger_mutex=PTHREAD_MUTEX_INITIALIZER;
 
 #define CTRIGINIT					\
   {							\
+    dispFlush();					\
     dispatch_busy = 0;					\
     memset((char *) evMasks, 0, sizeof(evMasks));	\
     memset((char *) syncTRtns, 0, sizeof(syncTRtns));	\
@@ -150,6 +163,88 @@ pthread_mutex_t trigger_mutex=PTHREAD_MUTEX_INITIALIZER;
 			   }						\
 			 }						\
 		       }
+/*
+  Queue a trigger (LOCKINTS held)
+*/
+
+static void dispEnqueue(DANODE *theNode)
+{
+  theNode->nevent = (int) dispSeq++;
+  listAdd(&dispSrcQ[theNode->source], theNode);
+  dispReady |= (1<<theNode->source);
+}
+
+/*
+  Take the trigger at the head of a source's queue (LOCKINTS held)
+*/
+
+static DANODE *dispDequeue(int theSource)
+{
+  DANODE *theNode;
+
+  listGet(&dispSrcQ[theSource], theNode);
+  if (dispSrcQ[theSource].c == 0)
+    dispReady &= ~(1<<theSource);
+
+  return theNode;
+}
+
+/*
+  Source of the oldest queued trigger among the sources in mask, with
+  event type theType (any type if theType < 0).  -1 if there is none.
+*/
+
+static int dispOldest(unsigned int mask, int theType)
+{
+  int src, oldest = -1;
+
+  for (; mask; mask &= mask - 1) {
+    src = __builtin_ctz(mask);
+    if ((theType >= 0) && (dispSrcQ[src].f->type != (unsigned int) theType))
+      continue;
+    if ((oldest < 0) ||
+	((int) ((unsigned int) dispSrcQ[src].f->nevent -
+		(unsigned int) dispSrcQ[oldest].f->nevent) < 0))
+      oldest = src;
+  }
+
+  return oldest;
+}
+
+/*
+  Empty the queues, without returning their nodes.  For when the
+  dispatch partition is created or freed, and its nodes go with it.
+*/
+
+static void dispReset()
+{
+  int src;
+
+  for (src = 0; src < MAXSRC; src++)
+    listInit(&dispSrcQ[src]);
+  dispReady = 0;
+  dispSeq = 0;
+}
+
+/*
+  Return all queued triggers to the dispatch partition
+*/
+
+static void dispFlush()
+{
+  int src;
+  DANODE *theNode;
+
+  for (src = 0; src < MAXSRC; src++) {
+    while (dispSrcQ[src].c) {
+      listGet(&dispSrcQ[src], theNode);
+      partFreeItem(theNode);
+    }
+  }
+  dispReady = 0;
+  dispSeq = 0;
+}
+
 /*
   Actually dispatch the triggers to the correct routines.
 */
@@ -157,47 +252,48 @@ pthread_mutex_t trigger_mutex=PTHREAD_MUTEX_INITIALIZER;
 static void cdodispatch()
 {
   unsigned int theType,theSource;
-  int go_on;
+  int src;
   DANODE *theNode;
 
   dispatch_busy = 1;
-  go_on = 1;
 
   /* While there are events */
 
-  while ((rol->dispQ->list.c) && (go_on)) {
+  while (dispReady) {
 
-    /* dequeue off head */
-    listGet(&rol->dispQ->list, theNode);
-    theType = theNode->type;
-    theSource = theNode->source;
     if (theEvMask) {
       /* We are already in an event */
-      /* is this source required for this event ? */
-      if ((theEvMask & (1<<theSource)) && (theType == currType)) {
-	/* yes */
-	/* remember we have seen it! */
-	theEvMask = theEvMask & ~(1<<theSource);
+      /* take the oldest trigger from a source this event still needs.
+	 Others wait on their own queues. */
+      src = dispOldest(theEvMask & dispReady, currType);
+      if (src < 0)
+	break;
 
-	/* call the routine */
-	UNLOCKINTS;
-	(*theNode->reader)(theType, Tcode[theSource]);
-	LOCKINTS;
-
-	/* done with this trigger */
-	if (theNode)
-	  /* partFreeItem(theNode); */
-	  if (!theEvMask) {
-	    if (wrapperGenerator) CECLOSE;	    /* if we called a wrap routine close the bank */
-	    WRITE_EVENT_;
-	  }
-      } else {
-	/* no so requeue on tail*/
-	listAdd(&rol->dispQ->list, theNode);
-	go_on = 0;
+      theNode = dispDequeue(src);
+      theType = theNode->type;
+      theSource = theNode->source;
+
+      /* remember we have seen it! */
+      theEvMask = theEvMask & ~(1<<theSource);
+
+      /* call the routine */
+      UNLOCKINTS;
+      (*theNode->reader)(theType, Tcode[theSource]);
+      LOCKINTS;
+
+      /* done with this trigger */
+      partFreeItem(theNode);
+      if (!theEvMask) {
+	if (wrapperGenerator) CECLOSE;	    /* if we called a wrap routine close the bank */
+	WRITE_EVENT_;
       }
     } else {
       /* We are not in an event */
+      /* start one with the oldest trigger */
+      theNode = dispDequeue(dispOldest(dispReady, -1));
+      theType = theNode->type;
+      theSource = theNode->source;
+
       /* get a new buffer... */
 
       if ((1<<theSource) & evMasks[theType]) {
@@ -261,7 +357,7 @@ static int theIntHandler(int theSource)
     theNode->source = theSource;
     theNode->type = (*ttypeRtns[theSource])(Tcode[theSource]);
     theNode->reader = (void *) trigRtns[theSource];
-    listAdd(&rol->dispQ->list, theNode);
+    dispEnqueue(theNode);
     if (!dispatch_busy)
       cdodispatch();
     UNLOCKINTS;
@@ -288,7 +384,7 @@ static int cdopolldispatch()
 	    theNode->source = theSource;
 	    theNode->type = (*ttypeRtns[theSource])(Tcode[theSource]);
 	    theNode->reader = (void *) trigRtns[theSource];
-	    listAdd(&rol->dispQ->list, theNode);
+	    dispEnqueue(theNode);
 	    if (!dispatch_busy)
 	      cdodispatch();
 	    UNLOCKINTS;
@@ -36,6 +36,7 @@
 #include "tsLib.h"
 #include "dmaBankTools.h"
 #include <TSPRIMARY_source.h>
+#include "rolTransTimer.h"
 extern void daLogMsg(char *severity, char *fmt,...);
 
 extern int bigendian_out;
@@ -116,6 +117,8 @@ static void __download()
 {
   int status;
 
+  rolTimerStart("Download");
+
   daLogMsg("INFO","Readout list compiled %s", DAYTIME);
   rol->poll = 1;
   *(rol->async_roc) = 0; /* Normal ROC */
@@ -127,6 +130,7 @@ static void __download()
   pthread_cond_init(&endrun_cv,NULL);
 
   /* Initialize memory partition library */
+  rolTimerBegin("dmaPCreate");
   dmaPartInit();
 
   /* Setup Buffer memory to store events */
@@ -140,6 +144,7 @@ static void __download()
   /* Reinitialize the Buffer memory */
   dmaPReInitAll();
   dmaPStatsAll();
+  rolTimerEnd();
 
   /* Set crate ID */
   tsSetCrateID_preInit(ROCID);
@@ -155,21 +160,29 @@ static void __download()
 #define TS_FLAG 0
 #endif
 
+  rolTimerBegin("tsInit");
   status = tsInit(TS_ADDR,TS_READOUT,TS_FLAG);
   if(status == -1) daLogMsg("ERROR","Unable to initialize TS Board\n");
 
   /* Set timestamp format 48 bits */
   tsSetEventFormat(3);
+  rolTimerEnd();
 
   /* Execute User defined download */
+  rolTimerBegin("rocDownload");
   rocDownload();
+  rolTimerEnd();
 
   daLogMsg("INFO","Download Executed");
 
+  rolTimerBegin("tsLinkReset");
   tsClockReset();
   taskDelay(2);
   tsTrigLinkReset();
   taskDelay(2);
+  rolTimerEnd();
+
+  rolTimerReport();
 
 
 } /*end download */
@@ -179,6 +192,8 @@ static void __download()
  */
 static void __prestart()
 {
+  rolTimerStart("Prestart");
+
   ACKLOCK;
   ack_runend=0;
   ACKUNLOCK;
@@ -195,20 +210,26 @@ static void __prestart()
   vmeCheckMutexHealth(10);
 
   /* Execute User defined prestart */
+  rolTimerBegin("rocPrestart");
   rocPrestart();
+  rolTimerEnd();
 
   /* Send a Sync Reset */
+  rolTimerBegin("tsSyncReset");
   printf("%s: Sending sync\n",__FUNCTION__);
   taskDelay(2);
   tsSyncReset(1); /* Set Block level as well */
   taskDelay(2);
   tsSetBlockLevel(blockLevel);
+  rolTimerEnd();
 
   /* Connect User Trigger Routine */
   tsIntConnect(TS_INT_VEC,asyncTrigger,0);
 
   daLogMsg("INFO","Prestart Executed");
 
+  rolTimerReport();
+
   if (__the_event__) WRITE_EVENT_;
   *(rol->nevents) = 0;
   rol->recNb = 0;
@@ -230,6 +251,8 @@ static void __pause()
  */
 static void __go()
 {
+  rolTimerStart("Go");
+
   daLogMsg("INFO","Entering Go");
   ACKLOCK;
   ack_runend=0;
@@ -239,10 +262,14 @@ static void __go()
   errCount=0;
 
   CDOENABLE(TSPRIMARY,1,1);
+  rolTimerBegin("rocGo");
   rocGo();
+  rolTimerEnd();
 
   tsIntEnable(1);
 
+  rolTimerReport();
+
   if (__the_event__) WRITE_EVENT_;
 }
 
@@ -253,10 +280,13 @@ static void __end()
 {
   unsigned int blockstatus=0;
 
+  rolTimerStart("End");
+
   tsDisableTriggerSource(1);
 
   blockstatus = tsBlockStatus(0,0);
 
+  rolTimerBegin("tsBlockDrain");
   ACKLOCK;
   ack_runend=1;
   if(blockstatus)
@@ -267,6 +297,7 @@ static void __end()
 	     __FUNCTION__,endrun_timedwait_ret,tsBlockStatus(0,0));
     }
   ACKUNLOCK;
+  rolTimerEnd();
 
   INTLOCK;
   INTUNLOCK;
@@ -275,7 +306,9 @@ static void __end()
   tsIntDisconnect();
 
   /* Execute User defined end */
+  rolTimerBegin("rocEnd");
   rocEnd();
+  rolTimerEnd();
 
   CDODISABLE(TSPRIMARY,1,0);
 
@@ -283,6 +316,8 @@ static void __end()
 
   daLogMsg("INFO","End Executed");
 
+  rolTimerReport();
+
   if (__the_event__) WRITE_EVENT_;
 } /* end end block */
 
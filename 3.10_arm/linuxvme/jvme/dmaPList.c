@@ -25,8 +25,16 @@
 #include <stdio.h>
 #include <pthread.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <search.h>
+#include <sched.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "jvme.h"
 #include "dmaPList.h"
 #include "jlabgef.h"
 #include "gef/gefcmn_vme_framework.h"
@@ -53,9 +61,23 @@ pthread_mutex_t   partMutex = PTHREAD_MUTEX_INITIALIZER;
 
 #define maximum(a,b) (a<b ? b : a)
 
+/* dmalistWait: CPU pauses before sleeping, and longest sleep (ns) before
+   re-checking the list (catches a "to" flag set without dmalistTimeout) */
+#define DMALIST_SPIN_COUNT  2000
+#define DMALIST_WAIT_NSEC   10000000
+
+#if defined(__i386__) || defined(__x86_64__)
+#define CPU_RELAX()  __asm__ __volatile__("pause" ::: "memory")
+#elif defined(__aarch64__) || (defined(__ARM_ARCH) && (__ARM_ARCH >= 7))
+#define CPU_RELAX()  __asm__ __volatile__("yield" ::: "memory")
+#else
+#define CPU_RELAX()  __sync_synchronize()
+#endif
+
 /* global data */
 static DMALIST  dmaPList;     /* global part list */
 static int useSlaveWindow=0;  /* decision to use (1) a Slave VME window (useful for SFI) */
+static int dmaPAlign=DMAP_ALIGN_DEFAULT; /* item data alignment for new partitions */
 extern void *a32slave_window; /* global variable from jlabgef.c */
 extern int a32slave_physmembase;
 /** Flag for turning off or on driver verbosity
@@ -63,6 +85,85 @@ extern int a32slave_physmembase;
 */
 extern unsigned int vmeQuietFlag;
 
+/*!
+  Lock-free ring of node pointers, used in place of a partition's list
+  (see dmaPSetQueueMode).  head and tail are free running counters, on
+  separate cache lines.  seq is only used by DMAP_QUEUE_MPMC.
+*/
+#define DMA_CACHE_LINE 64
+
+typedef struct
+{
+  volatile unsigned long seq;
+  DMANODE *node;
+} DMA_RING_CELL;
+
+struct dma_ring
+{
+  int            mode;
+  volatile int   full;           /* puts that found the ring full */
+  unsigned long  mask;           /* number of cells - 1 */
+  volatile unsigned long head __attribute__((aligned(DMA_CACHE_LINE))); /* next get */
+  volatile unsigned long tail __attribute__((aligned(DMA_CACHE_LINE))); /* next put */
+  DMA_RING_CELL  cell[0] __attribute__((aligned(DMA_CACHE_LINE)));
+};
+
+/*!
+  Item buffer of a packed partition (dmaPCreatePacked).  Items are
+  reserved one after the other from head, each with room for the largest
+  event, and wrap to the start of the buffer when they do not fit at the
+  end.  When an item is put on another partition (PUTEVENT), the part
+  of it after the event is given back, if it is still the last item.
+  rec[] holds the offset of each reserved item, oldest first, with bit 0
+  set once the item is freed.  Space is reused once the oldest items are
+  freed.  Guarded by the partition mutex.
+*/
+struct dma_packed
+{
+  char          *block;          /* allocation */
+  char          *base;           /* first item (data aligned) */
+  unsigned long  nbytes;         /* bytes from base */
+  unsigned long  head;           /* offset of the next item */
+  unsigned long  mask;           /* number of records - 1 */
+  unsigned long  rhead;          /* next record (free running) */
+  unsigned long  rtail;          /* oldest record (free running) */
+  unsigned long  peak;           /* most items reserved at once */
+  GEF_VME_DMA_HDL dmaHdl;
+  unsigned long  physMemBase;
+  unsigned int   rec[0];
+};
+
+/*!
+  Event trace histograms (dmaPTraceRecord).  Row 0 is the total time,
+  row i the time from stage i-1 to stage i.  Bin b counts intervals of
+  2^(b-1) to 2^b - 1 rdtsc ticks.  Written only by the thread that
+  records events, so no lock is needed; other threads only read them.
+*/
+#define DMAP_TRACE_NBIN 64
+
+typedef struct
+{
+  unsigned long long count;
+  unsigned long long sum;
+  unsigned long long max;
+  unsigned int       bin[DMAP_TRACE_NBIN];
+} DMAP_TRACE_HIST;
+
+static DMAP_TRACE_HIST dmaPTraceHist[DMAP_TRACE_NSTAGE];
+static double dmaPTraceTicksPerNs = 1.0;
+volatile int dmaPTraceFlag = 0;
+unsigned long long dmaPTraceTable[DMAP_TRACE_NSLOT][DMAP_TRACE_NSTAGE];
+volatile unsigned int dmaPTraceNext = 0;
+
+static const char *dmaPTraceName[DMAP_TRACE_NSTAGE] =
+  {
+    "trigger->write",
+    "trigger->readout",
+    "readout->putevent",
+    "putevent->usrtrig",
+    "usrtrig->write"
+  };
+
 /*! Buffer node pointer */
 DMANODE *the_event;
 /*! Data pointer */
@@ -152,6 +253,275 @@ dmaPUseSlaveWindow (int iFlag)
   return ERROR; /* Shouldn't get here, anyway */
 }
 
+/*!
+  Routine to set the alignment of each item's data (&node->data[0]) in
+  partitions created after this call.  Item sizes are rounded up to a
+  multiple of the alignment, so that every item in the block is aligned.
+  e.g. DMAP_ALIGN_CACHE_LINE keeps each event on its own cache lines, and
+  keeps the DMA engine writing whole lines.
+
+  @param align Alignment in bytes.  A power of 2 from DMAP_ALIGN_DEFAULT
+               (the default) to DMAP_ALIGN_MAX.
+
+  @return OK if successful, ERROR on error
+*/
+int
+dmaPSetAlignment(int align)
+{
+  if((align < DMAP_ALIGN_DEFAULT) || (align > DMAP_ALIGN_MAX) ||
+     (align & (align - 1)))
+    {
+      printf("%s: ERROR: Invalid align (%d).  Must be a power of 2 from %d to %d.\n",
+	     __func__, align, DMAP_ALIGN_DEFAULT, DMAP_ALIGN_MAX);
+      return ERROR;
+    }
+
+  dmaPAlign = align;
+
+  return OK;
+}
+
+/*
+  Bytes to skip at base, so that the data of a node there is aligned.
+  The allocator returns blocks aligned to at least 8 bytes, so this is
+  never more than align - DMAP_ALIGN_DEFAULT.
+*/
+static unsigned long
+dmaPAlignPad(DMA_MEM_ID pPart, char *base)
+{
+  return (-(unsigned long)&((DMANODE *)base)->data[0]) & (pPart->align - 1);
+}
+
+
+/*
+ * Lock-free partition queue (dmaPSetQueueMode)
+ *
+ *   dmaPRingPut   : Add a node to the tail of the ring.  ERROR if full.
+ *   dmaPRingGet   : Get a node from the head of the ring.  0 if empty.
+ *   dmaPRingCount : Number of nodes in the ring.
+ *   dmaPRingDrain : Move all nodes from the ring to the partition's list.
+ *   dmaPRingFill  : Move all nodes from the partition's list to the ring.
+ */
+
+static int
+dmaPRingPut(struct dma_ring *ring, DMANODE *node)
+{
+  DMA_RING_CELL *cell;
+  unsigned long pos, seq;
+  long dif;
+
+  if(ring->mode == DMAP_QUEUE_SPSC)
+    {
+      pos = ring->tail;
+      if(pos - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > ring->mask)
+	return ERROR;
+
+      ring->cell[pos & ring->mask].node = node;
+      __atomic_store_n(&ring->tail, pos + 1, __ATOMIC_RELEASE);
+      return OK;
+    }
+
+  pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  while(1)
+    {
+      cell = &ring->cell[pos & ring->mask];
+      seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+      dif = (long)seq - (long)pos;
+      if(dif == 0)
+	{
+	  if(__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+					 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    break;
+	}
+      else if(dif < 0)
+	return ERROR;
+      else
+	pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    }
+
+  cell->node = node;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return OK;
+}
+
+static DMANODE *
+dmaPRingGet(struct dma_ring *ring)
+{
+  DMA_RING_CELL *cell;
+  DMANODE *node;
+  unsigned long pos, seq;
+  long dif;
+
+  if(ring->mode == DMAP_QUEUE_SPSC)
+    {
+      pos = ring->head;
+      if(pos == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+	return 0;
+
+      node = ring->cell[pos & ring->mask].node;
+      __atomic_store_n(&ring->head, pos + 1, __ATOMIC_RELEASE);
+      return node;
+    }
+
+  pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  while(1)
+    {
+      cell = &ring->cell[pos & ring->mask];
+      seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+      dif = (long)seq - (long)(pos + 1);
+      if(dif == 0)
+	{
+	  if(__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+					 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	    break;
+	}
+      else if(dif < 0)
+	return 0;
+      else
+	pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+
+  node = cell->node;
+  __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+  return node;
+}
+
+static int
+dmaPRingCount(struct dma_ring *ring)
+{
+  unsigned long head;
+
+  head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  return (int)(__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - head);
+}
+
+static void
+dmaPRingDrain(DMA_MEM_ID pPart)
+{
+  DMANODE *theNode;
+
+  while((theNode = dmaPRingGet(pPart->ring)) != 0)
+    dmalistAdd(&pPart->list, theNode);
+}
+
+static void
+dmaPRingFill(DMA_MEM_ID pPart)
+{
+  DMANODE *theNode;
+
+  while(pPart->list.c)
+    {
+      dmalistGet(&pPart->list, theNode);
+      if(dmaPRingPut(pPart->ring, theNode) != OK)
+	{ /* dmaPSetQueueMode makes the ring deep enough, so not expected */
+	  printf("%s: ERROR: %s queue full\n", __func__, pPart->name);
+	  dmalistAdd(&pPart->list, theNode);
+	  break;
+	}
+    }
+}
+
+/* Put a node on a ring, waiting for the consumer if the ring is full.
+   The node may be taken (and reused) by another thread as soon as it is
+   put, so the caller must not touch it after this. */
+static void
+dmaPRingPutWait(DMA_MEM_ID pPart, DMANODE *pItem)
+{
+  while(dmaPRingPut(pPart->ring, pItem) != OK)
+    {
+      if(__sync_fetch_and_add(&pPart->ring->full, 1) == 0)
+	printf("%s: WARN: %s queue full.  Waiting for consumer.\n",
+	       __func__, pPart->name);
+      sched_yield();
+    }
+}
+
+/*!
+  Routine to select how a partition queues its nodes.
+
+  The default (DMAP_QUEUE_LIST) is a linked list, where dmaPGetItem,
+  dmaPAddItem and dmaPFreeItem all take the mutex shared by every
+  partition.  The other modes keep the nodes in a lock-free ring, and
+  dmaPNodeCount / dmaPEmpty become simple reads.
+
+  Call after dmaPCreate and before the partition is used by more than
+  one thread.  dmaPIncr can not add nodes to a partition in a ring mode.
+
+  @param pPart Partition
+  @param mode
+  - DMAP_QUEUE_LIST: linked list, with mutex
+  - DMAP_QUEUE_SPSC: lock-free ring.  Only one thread may add nodes
+                     (dmaPAddItem, dmaPFreeItem) and one thread get them.
+  - DMAP_QUEUE_MPMC: lock-free ring, any number of threads
+  @param depth Maximum nodes in the queue.  Raised to the number of nodes
+               owned by the partition, and rounded up to a power of 2.
+               A full queue makes dmaPAddItem/dmaPFreeItem wait.
+
+  @return OK if successful, ERROR on error
+*/
+int
+dmaPSetQueueMode(DMA_MEM_ID pPart, int mode, int depth)
+{
+  struct dma_ring *ring = NULL;
+  unsigned long ncell = 2, icell;
+
+  if(pPart == NULL)
+    {
+      printf("%s: ERROR: Invalid partition\n", __func__);
+      return ERROR;
+    }
+
+  if((mode < DMAP_QUEUE_LIST) || (mode > DMAP_QUEUE_MPMC))
+    {
+      printf("%s: ERROR: Invalid mode (%d)\n", __func__, mode);
+      return ERROR;
+    }
+
+  if(pPart->packed && (mode != DMAP_QUEUE_LIST))
+    {
+      printf("%s: ERROR: %s is a packed partition.  Only DMAP_QUEUE_LIST is supported.\n",
+	     __func__, pPart->name);
+      return ERROR;
+    }
+
+  if(mode != DMAP_QUEUE_LIST)
+    {
+      depth = maximum(depth, pPart->total);
+      depth = maximum(depth, (int)pPart->list.c);
+      if(pPart->ring)
+	depth = maximum(depth, dmaPRingCount(pPart->ring));
+      while(ncell < (unsigned long)depth)
+	ncell <<= 1;
+
+      if(posix_memalign((void **)&ring, DMA_CACHE_LINE,
+			sizeof(struct dma_ring) + ncell*sizeof(DMA_RING_CELL)) != 0)
+	{
+	  printf("%s: ERROR: Unable to allocate %s queue (depth %lu)\n",
+		 __func__, pPart->name, ncell);
+	  return ERROR;
+	}
+      memset(ring, 0, sizeof(struct dma_ring) + ncell*sizeof(DMA_RING_CELL));
+
+      ring->mode = mode;
+      ring->mask = ncell - 1;
+      for(icell = 0; icell < ncell; icell++)
+	ring->cell[icell].seq = icell;
+    }
+
+  PARTLOCK;
+  if(pPart->ring)
+    {
+      dmaPRingDrain(pPart);
+      free(pPart->ring);
+    }
+
+  pPart->ring = ring;
+  if(ring)
+    dmaPRingFill(pPart);
+  PARTUNLOCK;
+
+  return OK;
+}
 
 void
 dmaPartInit()
@@ -212,10 +582,11 @@ dmaPCreate(char *name, int size, int c, int incr)
       /* Increase size by 2KB (0x800) to allow extra space for DMA Flush */
       size += 0x800;
 
-      /* Check if the size needs to be increased to put the partition on
-	 an 8 byte boundary */
-      if((size + sizeof(DMANODE))%8 != 0)
-	size_incr = 8-(size + sizeof(DMANODE))%8;
+      /* Check if the size needs to be increased to keep the data of each
+	 item aligned (8 bytes, unless set by dmaPSetAlignment) */
+      pPart->align = dmaPAlign;
+      if((size + sizeof(DMANODE))%pPart->align != 0)
+	size_incr = pPart->align-(size + sizeof(DMANODE))%pPart->align;
 
       pPart->size = size + sizeof(DMANODE) + size_incr;
       pPart->incr = 0;
@@ -233,6 +604,233 @@ dmaPCreate(char *name, int size, int c, int incr)
   return pPart;
 }
 
+/*****************************************************************
+ *
+ *  Packed partition (dmaPCreatePacked)
+ *
+ *   dmaPPackedFit   : Where the next item goes, if there is room.
+ *   dmaPPackedCount : Number of largest items there is room for.
+ *   dmaPPackedGet   : Reserve an item.
+ *   dmaPPackedCommit: Give back the part of the last item after its event.
+ *   dmaPPackedFree  : Free an item, and the space of the oldest freed items.
+ *
+ */
+
+static int
+dmaPPackedFit(DMA_MEM_ID pPart, unsigned long *offset)
+{
+  struct dma_packed *pk = pPart->packed;
+  unsigned long size = pPart->size, tail;
+
+  if(pk->rhead == pk->rtail)
+    {
+      *offset = 0;
+      return (size <= pk->nbytes);
+    }
+
+  if((pk->rhead - pk->rtail) > pk->mask)
+    return 0;
+
+  tail = pk->rec[pk->rtail & pk->mask] & ~1UL;
+  if(pk->head > tail)
+    {
+      /* In use from tail to head: room after head, or before tail */
+      if(pk->head + size <= pk->nbytes)
+	{
+	  *offset = pk->head;
+	  return 1;
+	}
+      *offset = 0;
+      return (size <= tail);
+    }
+
+  /* Wrapped: room from head to tail */
+  *offset = pk->head;
+  return (pk->head + size <= tail);
+}
+
+static int
+dmaPPackedCount(DMA_MEM_ID pPart)
+{
+  struct dma_packed *pk = pPart->packed;
+  unsigned long size = pPart->size, tail;
+
+  if(pk->rhead == pk->rtail)
+    return (pk->nbytes / size);
+
+  if((pk->rhead - pk->rtail) > pk->mask)
+    return 0;
+
+  tail = pk->rec[pk->rtail & pk->mask] & ~1UL;
+  if(pk->head > tail)
+    return ((pk->nbytes - pk->head) / size + tail / size);
+
+  return ((tail - pk->head) / size);
+}
+
+static DMANODE *
+dmaPPackedGet(DMA_MEM_ID pPart)
+{
+  struct dma_packed *pk = pPart->packed;
+  unsigned long offset;
+  DMANODE *theNode;
+
+  if(!dmaPPackedFit(pPart, &offset))
+    return 0;
+
+  theNode = (DMANODE *)(pk->base + offset);
+  memset((char *)theNode, 0, offsetof(DMANODE, data));
+  theNode->part = pPart;
+  theNode->dmaHdl = pk->dmaHdl;
+  theNode->partBaseAdr = (unsigned long)pk->block;
+  theNode->physMemBase = pk->physMemBase;
+
+  pk->rec[pk->rhead & pk->mask] = offset;
+  pk->rhead++;
+  pk->head = offset + pPart->size;
+  if((pk->rhead - pk->rtail) > pk->peak)
+    pk->peak = pk->rhead - pk->rtail;
+
+  return theNode;
+}
+
+static void
+dmaPPackedCommit(DMANODE *pItem)
+{
+  struct dma_packed *pk = pItem->part->packed;
+  unsigned long offset = (char *)pItem - pk->base, bytes;
+
+  if((pk->rhead == pk->rtail) || (pk->rec[(pk->rhead - 1) & pk->mask] != offset))
+    return;
+
+  bytes = offsetof(DMANODE, data) + pItem->length*sizeof(unsigned int);
+  bytes = (bytes + pItem->part->align - 1) & ~((unsigned long)pItem->part->align - 1);
+  if(bytes < (unsigned long)pItem->part->size)
+    pk->head = offset + bytes;
+}
+
+static void
+dmaPPackedFree(DMANODE *pItem)
+{
+  struct dma_packed *pk = pItem->part->packed;
+  unsigned long offset = (char *)pItem - pk->base, irec;
+
+  for(irec = pk->rtail; irec != pk->rhead; irec++)
+    {
+      if(pk->rec[irec & pk->mask] == offset)
+	break;
+    }
+
+  if(irec == pk->rhead)
+    {
+      printf("%s: ERROR: 0x%lx is not a reserved item of %s\n",
+	     __func__, (unsigned long)pItem, pItem->part->name);
+      return;
+    }
+
+  pItem->length=0;
+  pk->rec[irec & pk->mask] |= 1;
+
+  while((pk->rtail != pk->rhead) && (pk->rec[pk->rtail & pk->mask] & 1))
+    pk->rtail++;
+
+  if(pk->rtail == pk->rhead)
+    pk->head = 0;
+}
+
+/*!
+  Create a packed memory partition.  Its items come from one buffer of
+  nbytes, each reserved with room for an event of up to size bytes.  When
+  an item is put on another partition (PUTEVENT), the space after its
+  event is given back, so small events take little more than their own
+  size, and more of them may be buffered than with dmaPCreate.
+  Items are used with dmaPGetItem, GETEVENT, PUTEVENT and dmaPFreeItem
+  as with any partition.  The space of an item is reused once it and
+  all items reserved before it are freed.
+
+  @param *name  Name of the new partition
+  @param size   Size of the largest item
+  @param nbytes Size of the buffer
+
+  @return Created memory partition
+*/
+DMA_MEM_ID
+dmaPCreatePacked(char *name, int size, int nbytes)
+{
+  DMA_MEM_ID pPart;
+  struct dma_packed *pk;
+  GEF_STATUS status;
+  GEF_VME_DMA_HDL dma_hdl;
+  GEF_MAP_PTR mapPtr;
+  unsigned long nrec = 2, minsize;
+  int align_bytes;
+
+  if((nbytes <= 0) || (nbytes > LINUX_MAX_PARTSIZE))
+    {
+      printf("%s: ERROR: Invalid nbytes (%d).  Must be from 1 to %d.\n",
+	     __func__, nbytes, LINUX_MAX_PARTSIZE);
+      return 0;
+    }
+
+  pPart = dmaPCreate(name, size, 0, 0);
+  if(pPart == 0)
+    return 0;
+
+  if(nbytes < pPart->size)
+    {
+      printf("%s: ERROR: nbytes (%d) is less than the item size (%d)\n",
+	     __func__, nbytes, pPart->size);
+      dmaPFree(pPart);
+      return 0;
+    }
+
+  /* One record for each of the most items that fit */
+  minsize = (sizeof(DMANODE) + pPart->align - 1) & ~((unsigned long)pPart->align - 1);
+  while(nrec < nbytes / minsize)
+    nrec <<= 1;
+
+  pk = (struct dma_packed *)calloc(1, sizeof(struct dma_packed) + nrec*sizeof(unsigned int));
+  if(pk == NULL)
+    {
+      printf("%s: ERROR: Unable to allocate %s records (%lu)\n",
+	     __func__, pPart->name, nrec);
+      dmaPFree(pPart);
+      return 0;
+    }
+
+  align_bytes = pPart->align - DMAP_ALIGN_DEFAULT;
+  status = gefVmeAllocDmaBuf (vmeHdl, nbytes + align_bytes,
+			      &dma_hdl,&mapPtr);
+  if(status != GEF_STATUS_SUCCESS)
+    {
+      jlabgefPrintGefError((char *)__func__, "gefVmeAllocDmaBuf", status);
+      printf("          nbytes requested = %d\n",nbytes + align_bytes);
+      free(pk);
+      dmaPFree(pPart);
+      return 0;
+    }
+
+  pk->block = (char *) mapPtr;
+  memset(pk->block, 0, nbytes + align_bytes);
+  pk->base = pk->block + dmaPAlignPad(pPart, pk->block);
+  pk->nbytes = nbytes;
+  pk->mask = nrec - 1;
+  pk->dmaHdl = dma_hdl;
+  pk->physMemBase = dmaHdl_to_PhysAddr(dma_hdl);
+
+#ifdef USE_TSEARCH
+  /* Add Physical Memory region info to Tree */
+  partPhysMem  = (DMA_PHYSMEM_INFO *)malloc(sizeof(DMA_PHYSMEM_INFO));
+  npartPhysMem = 0;
+  dmaMemAdd(pk->physMemBase + (unsigned long)(pk->base - pk->block), nbytes);
+#endif /* USE_TSEARCH */
+
+  pPart->total = nbytes / pPart->size;
+  pPart->packed = pk;
+
+  return pPart;
+}
+
 /*!
   Routine to find a memory partition based on its name
 
@@ -274,6 +872,24 @@ dmaPFree(DMA_MEM_ID pPart)
     printf("%s: free list %s\n",
 	   __func__, pPart->name);
 
+  if(pPart->ring)
+    {
+      dmaPRingDrain(pPart);
+      free(pPart->ring);
+      pPart->ring = NULL;
+    }
+
+  if(pPart->packed)
+    {
+      status = gefVmeFreeDmaBuf(pPart->packed->dmaHdl);
+      if(status != GEF_STATUS_SUCCESS)
+	{
+	  jlabgefPrintGefError((char *)__func__, "gefVmeFreeDmaBuf", status);
+	}
+      free(pPart->packed);
+      pPart->packed = NULL;
+    }
+
   if (pPart->incr == 1)
     {
       /* Free all buffers in the partition individually */
@@ -375,17 +991,33 @@ dmaPIncr(DMA_MEM_ID pPart, int c)
   register long *block;
   /*   unsigned bytes; */
   int total_bytes;
+  int align_bytes;		/* room to align the first item's data */
   int actual = c;		/* actual # of items added */
   GEF_STATUS status;
   GEF_MAP_PTR mapPtr;
   GEF_VME_DMA_HDL dma_hdl;
   long physMemBase=0;
 
+  if(pPart && pPart->ring)
+    {
+      printf("%s: ERROR: Unable to add nodes to %s in a lock-free queue mode\n",
+	     __func__, pPart->name);
+      return -1;
+    }
+
+  if(pPart && pPart->packed)
+    {
+      printf("%s: ERROR: Unable to add nodes to packed partition %s\n",
+	     __func__, pPart->name);
+      return -1;
+    }
+
   pPart->total += c;
 
   if ((pPart == NULL)||(c == 0)) return (0);
 
-  total_bytes =  c * pPart->size;
+  align_bytes = pPart->align - DMAP_ALIGN_DEFAULT;
+  total_bytes =  c * pPart->size + align_bytes;
 
   if(LINUX_MAX_PARTSIZE <= total_bytes)
     {
@@ -414,12 +1046,12 @@ dmaPIncr(DMA_MEM_ID pPart, int c)
 	  while (actual--)
 	    {
 	      /* Allocate memory for individual buffer */
-	      status = gefVmeAllocDmaBuf (vmeHdl,pPart->size,
+	      status = gefVmeAllocDmaBuf (vmeHdl,pPart->size + align_bytes,
 					  &dma_hdl,&mapPtr);
 	      if(status != GEF_STATUS_SUCCESS)
 		{
 		  jlabgefPrintGefError((char *)__func__, "gefVmeAllocDmaBuf", status);
-		  printf("                bytes requested = %d\n",pPart->size);
+		  printf("                bytes requested = %d\n",pPart->size + align_bytes);
 		  return -1;
 		}
 	      block = (long *) mapPtr;
@@ -433,21 +1065,22 @@ dmaPIncr(DMA_MEM_ID pPart, int c)
 		  return (-1);
 		}
 
-	      memset((char *) block, 0, pPart->size);
+	      memset((char *) block, 0, pPart->size + align_bytes);
 
-	      ((DMANODE *)block)->part = pPart; /* remember where we came from... */
-	      ((DMANODE *)block)->dmaHdl = dma_hdl;
-	      ((DMANODE *)block)->partBaseAdr = (unsigned long)block;
-	      ((DMANODE *)block)->physMemBase = dmaHdl_to_PhysAddr(dma_hdl);
+	      node = (char *) block + dmaPAlignPad(pPart, (char *) block);
+	      ((DMANODE *)node)->part = pPart; /* remember where we came from... */
+	      ((DMANODE *)node)->dmaHdl = dma_hdl;
+	      ((DMANODE *)node)->partBaseAdr = (unsigned long)block;
+	      ((DMANODE *)node)->physMemBase = dmaHdl_to_PhysAddr(dma_hdl);
 
 #ifdef USE_TSEARCH
 	      /* Add Physical Memory region info to Tree */
-	      dmaMemAdd( ((DMANODE *)block)->physMemBase +
-			 (unsigned long)&(((DMANODE *)block)->data[0]) -
-			 ((DMANODE *)block)->partBaseAdr,
+	      dmaMemAdd( ((DMANODE *)node)->physMemBase +
+			 (unsigned long)&(((DMANODE *)node)->data[0]) -
+			 ((DMANODE *)node)->partBaseAdr,
 			 pPart->size);
 #endif /* USE_TSEARCH */
-	      dmalistAdd (&pPart->list,(DMANODE *)block);
+	      dmalistAdd (&pPart->list,(DMANODE *)node);
 	    }
 	  return (c);
 	}
@@ -488,9 +1121,10 @@ dmaPIncr(DMA_MEM_ID pPart, int c)
 	}
 
       pPart->incr = 0;
-      memset((char *) block, 0, c * pPart->size);
+      memset((char *) block, 0, total_bytes);
 
-      node = (char *) block;
+      /* First item, with its data aligned */
+      node = (char *) block + dmaPAlignPad(pPart, (char *) block);
       *((char **) &pPart->part[0]) = node;
 
       /* Split large allocation into the individual buffers */
@@ -498,7 +1132,7 @@ dmaPIncr(DMA_MEM_ID pPart, int c)
 	{
 	  ((DMANODE *)node)->part = pPart; /* remember where we came from... */
 	  ((DMANODE *)node)->dmaHdl = dma_hdl;
-	  ((DMANODE *)node)->partBaseAdr = (pPart->part[0]);
+	  ((DMANODE *)node)->partBaseAdr = (unsigned long)block;
 	  ((DMANODE *)node)->physMemBase = physMemBase;
 
 #ifdef USE_TSEARCH
@@ -532,17 +1166,30 @@ dmaPIncr(DMA_MEM_ID pPart, int c)
  *
  */
 
-/*!
-  Free a buffer(node) back to its owner partition
+/* dmaPFreeItem for a node owned by a partition in a lock-free queue mode */
+static void
+dmaPFreeRingItem(DMANODE *pItem)
+{
+  DMA_MEM_ID pPart = pItem->part;
+  void (*free_cmd)() = pPart->free_cmd;
 
-  @param *pItem Buffer(node) to free
-*/
-void
-dmaPFreeItem(DMANODE *pItem)
+  pItem->length=0;
+  dmaPRingPutWait(pPart, pItem);
+
+  if(free_cmd != NULL)
+    {
+      PARTLOCK;
+      (*free_cmd) (pPart->clientData);
+      PARTUNLOCK;
+    }
+}
+
+/* dmaPFreeItem for a node owned by a list partition.  PARTLOCK must be held. */
+static void
+dmaPFreeListItem(DMANODE *pItem)
 {
   GEF_STATUS status;
 
-  PARTLOCK;
   /* if the node does not have an owner then delete it - otherwise add it back to
      the owner list - lock out interrupts to be safe */
   if ((pItem)->part == 0)
@@ -559,6 +1206,10 @@ dmaPFreeItem(DMANODE *pItem)
 	}
       pItem = 0;
     }
+  else if(pItem->part->packed)
+    {
+      dmaPPackedFree(pItem);
+    }
   else
     {
       pItem->length=0;
@@ -568,10 +1219,67 @@ dmaPFreeItem(DMANODE *pItem)
   /* execute any command accociated with freeing the buffer */
   if(pItem->part->free_cmd != NULL)
     (*(pItem->part->free_cmd)) (pItem->part->clientData);
+}
 
+/*!
+  Free a buffer(node) back to its owner partition
+
+  @param *pItem Buffer(node) to free
+*/
+void
+dmaPFreeItem(DMANODE *pItem)
+{
+  if(pItem->part && pItem->part->ring)
+    {
+      dmaPFreeRingItem(pItem);
+      return;
+    }
+
+  PARTLOCK;
+  dmaPFreeListItem(pItem);
   PARTUNLOCK;
 }
 
+/*!
+  Free several buffers(nodes) back to their owner partitions, taking the
+  partition mutex once for each run of nodes owned by list partitions.
+
+  @param **pItems Array of buffers(nodes) to free
+  @param nitems   Number of buffers in pItems
+*/
+void
+dmaPFreeItems(DMANODE **pItems, int nitems)
+{
+  int iitem, locked = 0;
+
+  /* A node may be reused as soon as it is freed, so each is checked
+     before it is freed, not after */
+  for(iitem = 0; iitem < nitems; iitem++)
+    {
+      if(pItems[iitem]->part && pItems[iitem]->part->ring)
+	{
+	  if(locked)
+	    {
+	      PARTUNLOCK;
+	      locked = 0;
+	    }
+	  dmaPFreeRingItem(pItems[iitem]);
+	}
+      else
+	{
+	  if(!locked)
+	    {
+	      PARTLOCK;
+	      locked = 1;
+	    }
+	  dmaPFreeListItem(pItems[iitem]);
+	}
+    }
+
+  if(locked)
+    PARTUNLOCK;
+}
+
 /*!
   Check if a Partition has available nodes
 
@@ -583,8 +1291,16 @@ int
 dmaPEmpty(DMA_MEM_ID pPart)
 {
   int rval;
+  unsigned long offset;
+
+  if(pPart->ring)
+    return (dmaPRingCount(pPart->ring) == 0);
+
   PARTLOCK;
-  rval = (pPart->list.c == 0);
+  if(pPart->packed)
+    rval = !dmaPPackedFit(pPart, &offset);
+  else
+    rval = (pPart->list.c == 0);
   PARTUNLOCK;
   return rval;
 }
@@ -600,8 +1316,15 @@ int
 dmaPNodeCount(DMA_MEM_ID pPart)
 {
   int rval;
+
+  if(pPart->ring)
+    return dmaPRingCount(pPart->ring);
+
   PARTLOCK;
-  rval = pPart->list.c;
+  if(pPart->packed)
+    rval = dmaPPackedCount(pPart);
+  else
+    rval = pPart->list.c;
   PARTUNLOCK;
   return rval;
 }
@@ -619,7 +1342,27 @@ dmaPGetItem(DMA_MEM_ID pPart)
 {
   DMANODE *theNode;
 
+  if(pPart->ring)
+    {
+      theNode = dmaPRingGet(pPart->ring);
+      if(theNode && (theNode->length > theNode->part->size))
+	{
+	  printf("%s: ERROR:", __func__);
+	  printf("  Event length (%d) is larger than the Event buffer size (%d).  (Event %d)\n",
+		 (int)theNode->length,theNode->part->size,
+		 (int)theNode->nevent);
+	}
+      return(theNode);
+    }
+
   PARTLOCK;
+  if(pPart->packed)
+    {
+      theNode = dmaPPackedGet(pPart);
+      PARTUNLOCK;
+      return(theNode);
+    }
+
   dmalistGet(&(pPart->list),theNode);
   if(!theNode)
     {
@@ -638,6 +1381,49 @@ dmaPGetItem(DMA_MEM_ID pPart)
   return(theNode);
 }
 
+/*!
+  Get (reserve) up to a maximum number of available nodes from a partition,
+  taking the partition mutex once.  Nodes are returned in queue order.
+
+  @param pPart    Partition to obtain the nodes
+  @param **pItems Array to hold the nodes
+  @param max      Maximum number of nodes to get
+
+  @return Number of nodes obtained (0 if the partition is empty).
+*/
+int
+dmaPGetItems(DMA_MEM_ID pPart, DMANODE **pItems, int max)
+{
+  DMANODE *theNode;
+  int nitems = 0;
+
+  if(pPart->ring)
+    {
+      while((nitems < max) && ((theNode = dmaPRingGet(pPart->ring)) != 0))
+	pItems[nitems++] = theNode;
+    }
+  else
+    {
+      PARTLOCK;
+      if(pPart->packed)
+	{
+	  while((nitems < max) && ((theNode = dmaPPackedGet(pPart)) != 0))
+	    pItems[nitems++] = theNode;
+	}
+      else
+	{
+	  while((nitems < max) && pPart->list.c)
+	    {
+	      dmalistGet(&(pPart->list),theNode);
+	      pItems[nitems++] = theNode;
+	    }
+	}
+      PARTUNLOCK;
+    }
+
+  return nitems;
+}
+
 /*!
   Add node to a specified partition's list
 
@@ -648,7 +1434,30 @@ void
 dmaPAddItem(DMA_MEM_ID pPart, DMANODE *pItem)
 {
 
+  if(pPart->ring)
+    {
+      /* Give back the unused part of a packed partition's item */
+      if(pItem->part && pItem->part->packed)
+	{
+	  PARTLOCK;
+	  dmaPPackedCommit(pItem);
+	  PARTUNLOCK;
+	}
+
+      if(pItem->length > pItem->part->size)
+	{
+	  printf("%s: ERROR:", __func__);
+	  printf("  Event length (%d) is larger than the Event buffer size (%d).  (Event %d)\n",
+		 (int)pItem->length,pItem->part->size,
+		 (int)pItem->nevent);
+	}
+      dmaPRingPutWait(pPart, pItem);
+      return;
+    }
+
   PARTLOCK;
+  if(pItem->part && pItem->part->packed)
+    dmaPPackedCommit(pItem);
   dmalistAdd(&(pPart->list),pItem);
   if(pItem->length > pItem->part->size)
     {
@@ -681,6 +1490,20 @@ dmaPReInit(DMA_MEM_ID pPart)
 
   if (pPart == NULL) return -1;
 
+  /* All items of a packed partition are free */
+  if (pPart->packed)
+    {
+      PARTLOCK;
+      pPart->packed->head = 0;
+      pPart->packed->rhead = pPart->packed->rtail = 0;
+      PARTUNLOCK;
+      return 0;
+    }
+
+  /* Nodes in a lock-free queue are reinitialized from the list */
+  if (pPart->ring)
+    dmaPRingDrain(pPart);
+
   if (pPart->incr == 1)
     {   /* Does this partition have a Fragmented buffer list */
       /* Check if partition has buffers that do not belong to it
@@ -732,6 +1555,10 @@ dmaPReInit(DMA_MEM_ID pPart)
 	  node += pPart->size;
 	}
     }
+
+  if (pPart->ring)
+    dmaPRingFill(pPart);
+
   return 0;
 }
 
@@ -785,7 +1612,7 @@ dmaPHdr()
 static void
 dmaPPrint(DMA_MEM_ID pPart)
 {
-  int freen;
+  int freen, busy;
 
 #ifdef ARCH_x86_64
   printf("0x%012lx ",(unsigned long)pPart);
@@ -796,10 +1623,19 @@ dmaPPrint(DMA_MEM_ID pPart)
   if (pPart != NULL)
     {
       freen = dmalistCount (&pPart->list);
+      if(pPart->ring)
+	freen += dmaPRingCount(pPart->ring);
+      busy = pPart->total - freen;
+      if(pPart->packed)
+	{
+	  /* free: largest items that fit, busy: items reserved */
+	  freen = dmaPPackedCount(pPart);
+	  busy = pPart->packed->rhead - pPart->packed->rtail;
+	}
       printf("%5d  %5d  %5d  %7d     %1d  (%6d)  %s\n",
 	     pPart->total,
 	     freen,
-	     pPart->total - freen,
+	     busy,
 	     pPart->size,
 	     pPart->incr,
 	     (((pPart->total * pPart->size) + 1023) / 1024),
@@ -875,6 +1711,256 @@ dmaPPrintList(DMALIST *admalist)
   return(0);
 }
 
+/*!
+  Enable or disable the per event trace stamps (dmaPTraceStamp).
+  Enabling clears the histograms, and measures the dmaPTraceTsc() rate.
+  The stamps are only taken by code compiled with DMAP_TRACE.
+
+  @param enable 1 to enable, 0 to disable
+
+  @return OK
+*/
+int
+dmaPTraceEnable(int enable)
+{
+  struct timespec t0, t1;
+  unsigned long long tsc0, tsc1;
+  double ns;
+
+  if(enable)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      tsc0 = dmaPTraceTsc();
+      usleep(20000);
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      tsc1 = dmaPTraceTsc();
+
+      ns = (double)(t1.tv_sec - t0.tv_sec)*1.e9 + (double)(t1.tv_nsec - t0.tv_nsec);
+      if((ns > 0) && (tsc1 > tsc0))
+	dmaPTraceTicksPerNs = (double)(tsc1 - tsc0) / ns;
+
+      dmaPTraceClear();
+    }
+
+  dmaPTraceFlag = enable ? 1 : 0;
+
+  return OK;
+}
+
+/*!
+  Clear the event trace histograms
+
+  @return OK
+*/
+int
+dmaPTraceClear()
+{
+  memset((char *)dmaPTraceHist, 0, sizeof(dmaPTraceHist));
+  return OK;
+}
+
+static inline void
+dmaPTraceFill(DMAP_TRACE_HIST *hist, unsigned long long ticks)
+{
+  int ibin = (ticks == 0) ? 0 : 64 - __builtin_clzll(ticks);
+
+  if(ibin >= DMAP_TRACE_NBIN)  /* stamps out of order (TSC skew) */
+    ibin = DMAP_TRACE_NBIN - 1;
+
+  hist->bin[ibin]++;
+  hist->count++;
+  hist->sum += ticks;
+  if(ticks > hist->max)
+    hist->max = ticks;
+}
+
+/*!
+  Add an event's trace stamps to the histograms.  Events without a
+  stamp for every stage (tracing enabled part way through) are skipped.
+  Must only be called from one thread at a time (e.g. the ROC's usrtrig).
+
+  @param tstamp The event's stamps, DMAP_TRACE_NSTAGE of them (dmaPTraceStamps)
+*/
+void
+dmaPTraceRecord(unsigned long long *tstamp)
+{
+  int istage;
+
+  for(istage = 0; istage < DMAP_TRACE_NSTAGE; istage++)
+    {
+      if(tstamp[istage] == 0)
+	return;
+    }
+
+  dmaPTraceFill(&dmaPTraceHist[0],
+		tstamp[DMAP_TRACE_NSTAGE - 1] - tstamp[DMAP_TRACE_TRIGGER]);
+  for(istage = 1; istage < DMAP_TRACE_NSTAGE; istage++)
+    dmaPTraceFill(&dmaPTraceHist[istage], tstamp[istage] - tstamp[istage - 1]);
+}
+
+/* Upper edge (ticks) of the bin holding fraction frac of the entries */
+static unsigned long long
+dmaPTraceQuantile(DMAP_TRACE_HIST *hist, double frac)
+{
+  unsigned long long sum = 0;
+  int ibin;
+
+  for(ibin = 0; ibin < DMAP_TRACE_NBIN; ibin++)
+    {
+      sum += hist->bin[ibin];
+      if(sum >= frac*hist->count)
+	break;
+    }
+
+  return (ibin >= DMAP_TRACE_NBIN - 1) ? hist->max : (1ULL << ibin);
+}
+
+/*!
+  Print statistics on the event trace histograms.  Median and 99% are
+  the upper edge of the (power of 2) histogram bin they fall in.
+
+  @return OK
+*/
+int
+dmaPTraceStats()
+{
+  DMAP_TRACE_HIST *hist;
+  int istage;
+
+  printf("Event trace: %s, %.3f ticks/ns\n",
+	 dmaPTraceFlag ? "enabled" : "disabled", dmaPTraceTicksPerNs);
+  printf("%-18s  %10s  %10s  %10s  %10s  %10s\n",
+	 "interval", "events", "mean(ns)", "median(ns)", "99%(ns)", "max(ns)");
+  printf("------------------  ----------  ----------  ----------  ----------  ----------\n");
+
+  for(istage = 1; istage <= DMAP_TRACE_NSTAGE; istage++)
+    {
+      /* Stage intervals first, then the total */
+      hist = &dmaPTraceHist[istage % DMAP_TRACE_NSTAGE];
+      if(hist->count == 0)
+	{
+	  printf("%-18s  %10d\n", dmaPTraceName[istage % DMAP_TRACE_NSTAGE], 0);
+	  continue;
+	}
+
+      printf("%-18s  %10llu  %10.0f  %10.0f  %10.0f  %10.0f\n",
+	     dmaPTraceName[istage % DMAP_TRACE_NSTAGE],
+	     hist->count,
+	     (double)hist->sum / hist->count / dmaPTraceTicksPerNs,
+	     dmaPTraceQuantile(hist, 0.5) / dmaPTraceTicksPerNs,
+	     dmaPTraceQuantile(hist, 0.99) / dmaPTraceTicksPerNs,
+	     hist->max / dmaPTraceTicksPerNs);
+    }
+
+  return OK;
+}
+
+/*!
+  Write the event trace histograms to a text file, for plotting.  One
+  line per bin: bin low and high edges (ns), then the count for each
+  interval.
+
+  @param filename Output file
+
+  @return OK if successful, otherwise ERROR.
+*/
+int
+dmaPTraceExport(char *filename)
+{
+  FILE *f;
+  int ibin, istage;
+
+  if(filename == NULL)
+    {
+      printf("%s: ERROR: Invalid filename\n", __func__);
+      return ERROR;
+    }
+
+  f = fopen(filename, "w");
+  if(f == NULL)
+    {
+      printf("%s: ERROR: Unable to open %s\n", __func__, filename);
+      perror("fopen");
+      return ERROR;
+    }
+
+  fprintf(f, "# dmaPList event trace, %.3f ticks/ns\n", dmaPTraceTicksPerNs);
+  fprintf(f, "# low(ns) high(ns)");
+  for(istage = 0; istage < DMAP_TRACE_NSTAGE; istage++)
+    fprintf(f, " %s", dmaPTraceName[istage]);
+  fprintf(f, "\n");
+
+  for(ibin = 0; ibin < DMAP_TRACE_NBIN; ibin++)
+    {
+      fprintf(f, "%.1f %.1f",
+	      (ibin ? (double)(1ULL << (ibin - 1)) : 0.) / dmaPTraceTicksPerNs,
+	      (double)(1ULL << ibin) / dmaPTraceTicksPerNs);
+      for(istage = 0; istage < DMAP_TRACE_NSTAGE; istage++)
+	fprintf(f, " %u", dmaPTraceHist[istage].bin[ibin]);
+      fprintf(f, "\n");
+    }
+
+  fclose(f);
+
+  return OK;
+}
+
+/*!
+  Block until a given list has a node, or its timeout flag is set.
+  Used by dmalistWait.
+
+  Spins for a short time with a CPU pause, then sleeps on the list's
+  wake sequence until dmalistAdd or dmalistTimeout wakes it.
+
+  @param *li List to wait on
+*/
+void
+dmalistWaitBlock(DMALIST *li)
+{
+  volatile long *c = (volatile long *)&li->c;
+  volatile int *to = (volatile int *)&li->to;
+  struct timespec ts;
+  unsigned int seq;
+  int ispin;
+
+  for(ispin = 0; ispin < DMALIST_SPIN_COUNT; ispin++)
+    {
+      if((*c != 0) || (*to != 0))
+	return;
+      CPU_RELAX();
+    }
+
+  __sync_fetch_and_add(&li->waiters, 1);
+  while(1)
+    {
+      seq = li->wseq;
+      __sync_synchronize(); /* read wseq before the count */
+      if((*c != 0) || (*to != 0))
+	break;
+
+      ts.tv_sec  = 0;
+      ts.tv_nsec = DMALIST_WAIT_NSEC;
+      /* returns immediately if wseq has moved on since it was read */
+      syscall(SYS_futex, &li->wseq, FUTEX_WAIT_PRIVATE, seq, &ts, NULL, 0);
+    }
+  __sync_fetch_and_sub(&li->waiters, 1);
+}
+
+/*!
+  Wake threads sleeping in dmalistWait on a given list.
+  Called by dmalistAdd and dmalistTimeout when there are waiters.
+
+  @param *li List to wake
+  @param n   Number of threads to wake.  0 to wake all.
+*/
+void
+dmalistWake(DMALIST *li, int n)
+{
+  __sync_fetch_and_add(&li->wseq, 1);
+  syscall(SYS_futex, &li->wseq, FUTEX_WAKE_PRIVATE, (n > 0) ? n : INT_MAX,
+	  NULL, NULL, 0);
+}
+
 #ifdef USE_TSEARCH
 static int
 dmaMemCompare(const void *pa, const void *pb)
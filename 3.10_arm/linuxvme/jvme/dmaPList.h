@@ -27,6 +27,25 @@
 #include <stdarg.h>
 #include "gef/gefcmn_vme.h"
 
+/*! \name Event trace stages (dmaPTraceStamps, dmaPTraceEnable)
+  \{ */
+#define DMAP_TRACE_TRIGGER   0  /*!< Trigger routine called (TI block ready) */
+#define DMAP_TRACE_READOUT   1  /*!< User readout (rocTrigger) started */
+#define DMAP_TRACE_PUTEVENT  2  /*!< Readout done, event put on the output partition */
+#define DMAP_TRACE_USRTRIG   3  /*!< Event taken off the output partition (usrtrig) */
+#define DMAP_TRACE_WRITE     4  /*!< Event handed to the ROC output (WRITE_EVENT_) */
+#define DMAP_TRACE_NSTAGE    5
+#define DMAP_TRACE_NSLOT  4096  /*!< Events traced at once (dmaPTraceTable rows, power of 2) */
+/*  \} */
+
+/*
+  The DMANODE, DMALIST and DMA_MEM_PART layouts below, and the macros
+  that use them, are compiled into the ROL and must match the libjvme
+  it links against.  After changing this header, rebuild and install
+  libjvme with it (make install, or make coda_install) before building
+  a ROL against the copy in $LINUXVME_INC.
+*/
+
 /*! Node of a linked list. */
 typedef struct dmanode
 {
@@ -43,7 +62,7 @@ typedef struct dmanode
   void                   (*reader)();         /*!< routine to read data if data segment is empty */
   long                   nevent;              /*!< event number */
   unsigned long          length;	      /*!< Length of data to follow (bytes). */
-  unsigned long           blank[1];            /*!< Blank Spacer to align "data" on 8byte bound */
+  unsigned long           blank[1];            /*!< Blank Spacer to align "data" on 8byte bound.  Trace slot, when tracing */
   unsigned int           data[1];	      /*!< Node data. */
 } DMANODE;
 
@@ -56,6 +75,8 @@ typedef struct admalist
   int            to;
   void          (*add_cmd)(struct admalist *li);     /*!< command to call on list add */
   void          *clientData;                  /*!< data to pass for add_cmd */
+  volatile unsigned int wseq;                 /*!< wake sequence (futex word) for dmalistWait */
+  volatile int   waiters;                     /*!< Number of threads sleeping in dmalistWait */
 } DMALIST;
 
 /*! Pointer to Memory partition structure */
@@ -73,10 +94,27 @@ typedef struct dma_mem_part
   int		 size;		/*!< size of a single item */
   int		 incr;		/*!< Flag incr=1 when memory pool is fragmented */
   int		 total;		/*!< total items allocated so far */
+  int		 align;		/*!< alignment (bytes) of each item's data */
+  struct dma_ring *ring;        /*!< lock-free node queue, if not DMAP_QUEUE_LIST */
+  struct dma_packed *packed;    /*!< item buffer, if created with dmaPCreatePacked */
 
   long         part[1];	/*!< pointer to memory pool */
 } DMA_MEM_PART;
 
+/*! \name Partition queue modes (dmaPSetQueueMode)
+  \{ */
+#define DMAP_QUEUE_LIST   0  /*!< Linked list, guarded by the partition mutex */
+#define DMAP_QUEUE_SPSC   1  /*!< Lock-free ring, one producer and one consumer thread */
+#define DMAP_QUEUE_MPMC   2  /*!< Lock-free ring, any number of threads */
+/*  \} */
+
+/*! \name Item data alignment (dmaPSetAlignment)
+  \{ */
+#define DMAP_ALIGN_DEFAULT       8  /*!< data on an 8 byte boundary */
+#define DMAP_ALIGN_CACHE_LINE   64  /*!< data starts on a cache line */
+#define DMAP_ALIGN_MAX        4096  /*!< data starts on a page */
+/*  \} */
+
 /*! \name List manipulation Macros
   \{ */
 /*! Initialize a given dma list (li)
@@ -99,13 +137,13 @@ typedef struct dma_mem_part
     }						\
   }
 
-/*!
+/*! Wait for a node (no) on a given list (li).  Spins briefly, then
+  sleeps until dmalistAdd or dmalistTimeout.  (no) = -1 after a timeout.
   \hideinitializer
 */
 #define dmalistWait(li,no) {					    \
     (no) = 0;(li)->to = 0;					    \
-    while(((li)->c == 0) && ((li)->to == 0)) {			    \
-    };								    \
+    dmalistWaitBlock((li));					    \
     if ((li)->to == 0) {					    \
       (li)->c--;						    \
       (no) = (li)->f;						    \
@@ -131,10 +169,23 @@ typedef struct dma_mem_part
     }									\
     (no)->n = 0;							\
     (li)->c++;								\
+    __sync_synchronize();						\
+    if((li)->waiters)							\
+      dmalistWake((li), 1);						\
     if((li)->add_cmd != NULL)						\
       (*((li)->add_cmd)) ((li));					\
   }
 
+/*! Stop a dmalistWait on a given list (li)
+  \hideinitializer
+*/
+#define dmalistTimeout(li) {			\
+    (li)->to = 1;				\
+    __sync_synchronize();			\
+    if((li)->waiters)				\
+      dmalistWake((li), 0);			\
+  }
+
 /*!
   \hideinitializer
 */
@@ -192,6 +243,7 @@ typedef struct dma_mem_part
     } else {								\
       dma_dabufp = (unsigned int *) &(the_event->data[0]);		\
       the_event->nevent = num;						\
+      dmaPTraceClearStamps(the_event);					\
     }									\
   }									\
 
@@ -203,30 +255,100 @@ typedef struct dma_mem_part
 #define PUTEVENT(part)      {						\
     the_event->length =							\
       (((long)(dma_dabufp) - (long)(&the_event->data[0]))>>2);		\
+    dmaPTraceStamp(the_event, DMAP_TRACE_PUTEVENT);			\
     dmaPAddItem(part,the_event);					\
   }									\
 /* \} */
 
+/*! \name Event trace macros
+  The stamps are compiled in only if DMAP_TRACE is defined before this
+  header is included.  Otherwise these macros are empty.
+  \{ */
+/*! Non-zero when event tracing is enabled (dmaPTraceEnable) */
+extern volatile int dmaPTraceFlag;
+
+/*! Trace stamps, one row per event being traced.  Kept out of DMANODE so
+  that tracing does not change its layout: GETEVENT gives each traced
+  event the next row (round robin), and keeps its index in the node's
+  spacer.  More than DMAP_TRACE_NSLOT events in flight share rows. */
+extern unsigned long long dmaPTraceTable[DMAP_TRACE_NSLOT][DMAP_TRACE_NSTAGE];
+extern volatile unsigned int dmaPTraceNext;
+
+/*! A node's (no) trace stamps: its row of dmaPTraceTable
+  \hideinitializer
+*/
+#define dmaPTraceStamps(no)					\
+  (dmaPTraceTable[(no)->blank[0] & (DMAP_TRACE_NSLOT - 1)])
+
+/*! Time stamp counter for the trace stamps: rdtsc(), inlined where possible */
+static inline unsigned long long
+dmaPTraceTsc()
+{
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  extern unsigned long long int rdtsc(void);
+  return rdtsc();
+#endif
+}
+
+#ifdef DMAP_TRACE
+/*! Record the time in a node's (no) trace stamp for stage (stage), if tracing
+  \hideinitializer
+*/
+#define dmaPTraceStamp(no,stage) {			\
+    if(dmaPTraceFlag)					\
+      dmaPTraceStamps(no)[(stage)] = dmaPTraceTsc();	\
+  }
+
+/*! Give a node (no) a new, cleared row of trace stamps, if tracing.
+  \hideinitializer
+*/
+#define dmaPTraceClearStamps(no) {					\
+    if(dmaPTraceFlag)							\
+      {									\
+	(no)->blank[0] = __sync_fetch_and_add(&dmaPTraceNext, 1);	\
+	memset((char *)dmaPTraceStamps(no), 0, sizeof(dmaPTraceTable[0])); \
+      }									\
+  }
+#else
+#define dmaPTraceStamp(no,stage) {}
+#define dmaPTraceClearStamps(no) {}
+#endif /* DMAP_TRACE */
+/* \} */
+
 
 /* Prototypes */
 unsigned long dmaHdl_to_PhysAddr(GEF_VME_DMA_HDL inpDmaHdl);
 int        dmaPUseSlaveWindow(int iFlag);
+int        dmaPSetQueueMode(DMA_MEM_ID pPart, int mode, int depth);
+int        dmaPSetAlignment(int align);
 void       dmaPartInit();
 DMA_MEM_ID dmaPCreate (char *name, int size, int c, int incr);
+DMA_MEM_ID dmaPCreatePacked (char *name, int size, int nbytes);
 DMA_MEM_ID dmaPFindByName (char *name);
 void       dmaPFree(DMA_MEM_ID pPart);
 void       dmaPFreeAll();
 int        dmaPIncr ( DMA_MEM_ID pPart, int c);
 void       dmaPFreeItem(DMANODE *pItem);
+void       dmaPFreeItems(DMANODE **pItems, int nitems);
 int        dmaPEmpty(DMA_MEM_ID pPart);
 int        dmaPNodeCount(DMA_MEM_ID pPart);
 DMANODE   *dmaPGetItem(DMA_MEM_ID pPart);
+int        dmaPGetItems(DMA_MEM_ID pPart, DMANODE **pItems, int max);
 void       dmaPAddItem(DMA_MEM_ID pPart, DMANODE *pItem);
 int        dmaPReInit (DMA_MEM_ID pPart);
 int        dmaPReInitAll();
 int        dmaPStats (DMA_MEM_ID pPart);
 int        dmaPStatsAll();
 int        dmaPPrintList(DMALIST *admalist);
+int        dmaPTraceEnable(int enable);
+int        dmaPTraceClear();
+void       dmaPTraceRecord(unsigned long long *tstamp);
+int        dmaPTraceStats();
+int        dmaPTraceExport(char *filename);
+void       dmalistWaitBlock(DMALIST *li);
+void       dmalistWake(DMALIST *li, int n);
 int        dmaPMemIsValid(unsigned long physMem);
 
 #endif
@@ -0,0 +1,205 @@
+/*
+ * File:
+ *    bankBuilderBench.cc
+ *
+ * Description:
+ *    Benchmark of the C++ bank builder (BankBuilder.hxx) against the
+ *    BANKOPEN/BANKCLOSE macros (dmaBankTools.h).
+ *
+ *    Both write the same event to a vmeIN buffer through dma_dabufp:
+ *      - a TI bank (uint32_t) of 8 + 2*blockLevel words
+ *      - NMODULE module banks (uint32_t) of "words" words
+ *    The two outputs are compared, and the time per event of each is
+ *    reported.  A bank of 16 bit segments (not possible with the macros)
+ *    is then built and its headers printed.
+ *
+ *    Build with -O2 -DNDEBUG to compare with the macros (no bounds check).
+ *
+ *    Usage: bankBuilderBench [number of events]
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+extern "C" {
+#include "jvme.h"
+}
+#define BT_UI4_ty  0x01
+#include "dmaBankTools.h"
+#include "BankBuilder.hxx"
+
+#define BUFFER_SIZE 1024*40
+#define NMODULE     4
+#define BLOCKLEVEL  1
+
+#define NEVENTS_DEFAULT 5000000
+
+extern "C" DMANODE *the_event;
+extern "C" unsigned int *dma_dabufp;
+
+static int nwords;
+
+static double
+nowSec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1.e-9;
+}
+
+/* Event with the dmaBankTools.h macros */
+static void __attribute__((noinline))
+macroEvent(int iev)
+{
+  int imod, iword;
+
+  BANKOPEN(4, BT_UI4, 0);
+  for(iword = 0; iword < 8 + 2*BLOCKLEVEL; iword++)
+    *dma_dabufp++ = iev + iword;
+  BANKCLOSE;
+
+  for(imod = 0; imod < NMODULE; imod++)
+    {
+      BANKOPEN(3, BT_UI4, imod);
+      for(iword = 0; iword < nwords; iword++)
+	*dma_dabufp++ = (imod << 24) | iword;
+      BANKCLOSE;
+    }
+}
+
+/* Same event with BankBuilder.hxx */
+static void __attribute__((noinline))
+builderEvent(int iev)
+{
+  codaBank::Buffer buf(dma_dabufp, codaBank::bufferEnd(the_event));
+  int imod, iword;
+
+  {
+    codaBank::Bank<uint32_t> ti(buf, 4, 0);
+    for(iword = 0; iword < 8 + 2*BLOCKLEVEL; iword++)
+      ti << iev + iword;
+  }
+
+  for(imod = 0; imod < NMODULE; imod++)
+    {
+      codaBank::Bank<uint32_t> mod(buf, 3, imod);
+      unsigned int *data = mod.data();
+      for(iword = 0; iword < nwords; iword++)
+	*data++ = (imod << 24) | iword;
+      mod.advance(nwords);
+    }
+}
+
+/* Time per event (ns) writing nevents events with fill() */
+static double
+runEvents(void (*fill)(int), int nevents)
+{
+  unsigned int *start = &the_event->data[0];
+  double t0;
+  int iev;
+
+  t0 = nowSec();
+  for(iev = 0; iev < nevents; iev++)
+    {
+      dma_dabufp = start;
+      fill(iev);
+    }
+
+  return (nowSec() - t0) / nevents * 1.e9;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int sizes[] = { 4, 32, 256 }, isize;
+  int nevents = NEVENTS_DEFAULT;
+  unsigned int *copy;
+  long len, len2;
+  DMA_MEM_ID vmeIN;
+  double nsMacro, nsBuilder;
+  int status, iword, same;
+
+  if(argc > 1)
+    nevents = atoi(argv[1]);
+  if(nevents < 1)
+    nevents = NEVENTS_DEFAULT;
+
+  printf("\nBank builder benchmark: %d events, %d module banks\n",
+	 nevents, NMODULE);
+  printf("----------------------------\n");
+
+  status = vmeOpenDefaultWindows();
+  if(status != OK)
+    {
+      printf("vmeOpenDefaultWindows failed with code = 0x%x\n",status);
+      goto CLOSE;
+    }
+  vmeSetQuietFlag(1);
+
+  dmaPFreeAll();
+  vmeIN = dmaPCreate((char *)"vmeIN",BUFFER_SIZE,1,0);
+  if(vmeIN == 0)
+    {
+      printf("Unable to allocate memory for event buffers\n");
+      goto CLOSE;
+    }
+  dmaPReInitAll();
+  the_event = dmaPGetItem(vmeIN);
+  copy = (unsigned int *)malloc(BUFFER_SIZE);
+
+  printf("%8s %14s %14s %8s %8s\n", "words", "macros(ns)", "builder(ns)", "ratio", "same");
+  for(isize = 0; isize < (int)(sizeof(sizes)/sizeof(int)); isize++)
+    {
+      nwords = sizes[isize];
+
+      /* Same output? */
+      dma_dabufp = &the_event->data[0];
+      macroEvent(1);
+      len = dma_dabufp - &the_event->data[0];
+      memcpy(copy, &the_event->data[0], len*sizeof(unsigned int));
+      memset(&the_event->data[0], 0xff, len*sizeof(unsigned int));
+
+      dma_dabufp = &the_event->data[0];
+      builderEvent(1);
+      len2 = dma_dabufp - &the_event->data[0];
+      same = (len == len2) &&
+	(memcmp(copy, &the_event->data[0], len*sizeof(unsigned int)) == 0);
+
+      nsMacro   = runEvents(macroEvent, nevents);
+      nsBuilder = runEvents(builderEvent, nevents);
+
+      printf("%8d %14.1f %14.1f %7.2fx %8s\n",
+	     nwords, nsMacro, nsBuilder, nsBuilder/nsMacro, same ? "yes" : "NO");
+    }
+
+  /* Bank of 16 bit segments, with padding */
+  dma_dabufp = &the_event->data[0];
+  {
+    codaBank::Buffer buf(dma_dabufp, codaBank::bufferEnd(the_event));
+    codaBank::Bank<codaBank::segment_t> adc(buf, 5, 1);
+    {
+      codaBank::Segment<uint16_t> ch(buf, 1);
+      ch << 0x111 << 0x222 << 0x333;
+    }
+    {
+      codaBank::Segment<uint8_t> flags(buf, 2);
+      flags << 1;
+    }
+  }
+  len = dma_dabufp - &the_event->data[0];
+  printf("\nBank of segments (%ld words):", len);
+  for(iword = 0; iword < len; iword++)
+    printf(" 0x%08x", the_event->data[iword]);
+  printf("\n");
+
+  free(copy);
+  dmaPFreeItem(the_event);
+
+ CLOSE:
+  dmaPFreeAll();
+  vmeCloseDefaultWindows();
+
+  return 0;
+}
@@ -0,0 +1,306 @@
+/*
+ * File:
+ *    dispatchBench.c
+ *
+ * Description:
+ *    Benchmark of the trigger_dispatch.h dispatcher with several async
+ *    trigger sources that are all needed for each event (CRTTYPE).
+ *
+ *    Each source triggers once per event period, with a random delay of
+ *    up to JITTER periods, so the sources run ahead of each other.  Every
+ *    trigger goes through theIntHandler, as with CTRIGRSA sources, and is
+ *    dispatched by:
+ *      queues: the per source queues of trigger_dispatch.h
+ *      fifo:   the previous single dispQ list, which puts a trigger the
+ *              current event does not need back on the tail and stops
+ *    The time per trigger, the number of complete events, the number of
+ *    requeues (fifo), and the triggers lost for lack of a dispatch node
+ *    are reported.  Each event is checked to have one trigger from each
+ *    source, in order.
+ *
+ *    No VME hardware is needed.
+ *
+ *    Usage: dispatchBench [number of events]
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Just enough of rol.h for trigger_dispatch.h */
+typedef void (*VOIDFUNCPTR) ();
+typedef long (*FUNCPTR) ();
+#include "mempart.h"
+
+struct
+{
+  ROL_MEM_PART *dispatch, *dispQ, *pool, *output, *input;
+  unsigned int *dabufp, *dabufpi, *nevents;
+  int doDone;
+} rolBench, *rol = &rolBench;
+
+#define CECLOSE
+
+static void __done();
+
+#include "trigger_dispatch.h"
+
+/* A trigger source for CTRIGRSA, with the source id as its code */
+#define BENCH_ASYNC(code,id)
+#define BENCH_TTYPE benchTtype
+#define BENCH_GETID(code) (code)
+
+#define NEVENTS_DEFAULT  200000
+#define JITTER           4        /* event periods */
+#define NDISPATCH        65536    /* dispatch nodes */
+
+static int benchTtype(int code) { return 1; }
+
+static ROL_MEM_PART dispatchPart, poolPart;
+static DANODE dummyPool;
+static unsigned int nevents;
+static int nsrc, ntrig[MAXSRC], ncomplete, nerror, nrequeue, nlost;
+
+void
+benchTrig(int type, int code)
+{
+  ntrig[code]++;
+}
+
+void
+benchDone()
+{
+}
+
+/* WRITE_EVENT_: one complete event.  Check it has the next trigger of each source */
+static void
+__done()
+{
+  int isrc;
+
+  ncomplete++;
+  for(isrc = 1; isrc <= nsrc; isrc++)
+    {
+      if(ntrig[isrc] != ncomplete)
+	nerror++;
+    }
+}
+
+/*
+  The dispatcher before the per source queues: one FIFO (rol->dispQ)
+*/
+static void
+fifoDispatch()
+{
+  unsigned int theType,theSource;
+  int go_on;
+  DANODE *theNode;
+
+  dispatch_busy = 1;
+  go_on = 1;
+
+  while ((rol->dispQ->list.c) && (go_on)) {
+    listGet(&rol->dispQ->list, theNode);
+    theType = theNode->type;
+    theSource = theNode->source;
+    if (theEvMask) {
+      if ((theEvMask & (1<<theSource)) && (theType == currType)) {
+	theEvMask = theEvMask & ~(1<<theSource);
+	UNLOCKINTS;
+	(*theNode->reader)(theType, Tcode[theSource]);
+	LOCKINTS;
+	partFreeItem(theNode);
+	if (!theEvMask) {
+	  WRITE_EVENT_;
+	}
+      } else {
+	listAdd(&rol->dispQ->list, theNode);
+	nrequeue++;
+	go_on = 0;
+      }
+    } else {
+      if ((1<<theSource) & evMasks[theType]) {
+	currEvMask = theEvMask = evMasks[theType];
+	currType = theType;
+      } else {
+        currEvMask = (1<<theSource);
+      }
+      (*(rol->nevents))++;
+      UNLOCKINTS;
+      (*theNode->reader)(theType, Tcode[theSource]);
+      LOCKINTS;
+      partFreeItem(theNode);
+      if (theEvMask) {
+	theEvMask = theEvMask & ~(1<<theSource);
+      }
+      if (!theEvMask) {
+	WRITE_EVENT_;
+      }
+    }
+  }
+  dispatch_busy = 0;
+}
+
+static int
+fifoIntHandler(int theSource)
+{
+  DANODE *theNode;
+
+  LOCKINTS;
+  partGetItem(rol->dispatch, theNode);
+  if(theNode == 0)
+    {
+      nlost++;
+      UNLOCKINTS;
+      return 0;
+    }
+  theNode->source = theSource;
+  theNode->type = (*ttypeRtns[theSource])(Tcode[theSource]);
+  theNode->reader = (void *) trigRtns[theSource];
+  listAdd(&rol->dispQ->list, theNode);
+  if (!dispatch_busy)
+    fifoDispatch();
+  UNLOCKINTS;
+
+  return 0;
+}
+
+/* Trigger arrival: source and time (event periods) */
+typedef struct
+{
+  int    source;
+  double time;
+} ARRIVAL;
+
+static int
+compareArrival(const void *a, const void *b)
+{
+  double ta = ((const ARRIVAL *)a)->time, tb = ((const ARRIVAL *)b)->time;
+  return (ta > tb) - (ta < tb);
+}
+
+static double
+nowSec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1.e-9;
+}
+
+/* Dispatch all arrivals, with the fifo or the per source queues.
+   Returns time per trigger (ns) */
+static double
+runBench(ARRIVAL *arrival, int narrival, int fifo)
+{
+  DANODE *theNode;
+  double t0;
+  int iarr, isrc;
+
+  CTRIGINIT;
+  while(rol->dispQ->list.c)
+    {
+      listGet(&rol->dispQ->list, theNode);
+      partFreeItem(theNode);
+    }
+  for(isrc = 1; isrc <= nsrc; isrc++)
+    {
+      CTRIGRSA(BENCH,isrc,benchTrig,benchDone);
+      CRTTYPE(1,BENCH,isrc);
+    }
+  memset(ntrig, 0, sizeof(ntrig));
+  ncomplete = nerror = nrequeue = nlost = 0;
+
+  t0 = nowSec();
+  for(iarr = 0; iarr < narrival; iarr++)
+    {
+      if(fifo)
+	{
+	  fifoIntHandler(arrival[iarr].source);
+	}
+      else
+	{
+	  if(rol->dispatch->list.c == 0)
+	    nlost++;
+	  else
+	    theIntHandler(arrival[iarr].source);
+	}
+    }
+
+  return (nowSec() - t0) / narrival * 1.e9;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int sources[] = { 2, 4, 8, 16 }, isource;
+  int nevent = NEVENTS_DEFAULT, narrival, iev, isrc, inode, fifo;
+  ARRIVAL *arrival;
+  DANODE *node;
+  double ns;
+
+  /* trigger_dispatch.h statics not used here */
+  (void)cdopolldispatch;
+  (void)dispReset;
+  (void)__user_event__;
+  (void)intLockKey;
+
+  if(argc > 1)
+    nevent = atoi(argv[1]);
+  if(nevent < 1)
+    nevent = NEVENTS_DEFAULT;
+
+  /* Partitions */
+  rol->dispatch = &dispatchPart;
+  rol->dispQ    = (ROL_MEM_PART *)calloc(1, sizeof(ROL_MEM_PART));
+  rol->pool     = &poolPart;
+  rol->nevents  = &nevents;
+  listInit(&dispatchPart.list);
+  for(inode = 0; inode < NDISPATCH; inode++)
+    {
+      node = (DANODE *)calloc(1, sizeof(DANODE));
+      node->part = &dispatchPart;
+      listAdd(&dispatchPart.list, node);
+    }
+  listInit(&poolPart.list);
+  listAdd(&poolPart.list, &dummyPool); /* so WRITE_EVENT_ calls __done */
+
+  arrival = (ARRIVAL *)malloc(MAXSRC * nevent * sizeof(ARRIVAL));
+
+  printf("\nTrigger dispatch benchmark: %d events, sources up to %d periods apart\n",
+	 nevent, JITTER);
+  printf("----------------------------\n");
+  printf("%7s %7s %10s %10s %10s %10s %8s\n",
+	 "sources", "", "ns/trig", "events", "requeues", "lost", "errors");
+
+  for(isource = 0; isource < (int)(sizeof(sources)/sizeof(int)); isource++)
+    {
+      nsrc = sources[isource];
+
+      srand(1);
+      narrival = 0;
+      for(isrc = 1; isrc <= nsrc; isrc++)
+	{
+	  for(iev = 0; iev < nevent; iev++)
+	    {
+	      arrival[narrival].source = isrc;
+	      arrival[narrival].time = iev + JITTER * (rand() / (RAND_MAX + 1.0));
+	      narrival++;
+	    }
+	}
+      qsort(arrival, narrival, sizeof(ARRIVAL), compareArrival);
+
+      for(fifo = 1; fifo >= 0; fifo--)
+	{
+	  ns = runBench(arrival, narrival, fifo);
+	  printf("%7d %7s %10.1f %10d %10d %10d %8d\n",
+		 nsrc, fifo ? "fifo" : "queues", ns, ncomplete, nrequeue, nlost, nerror);
+	}
+    }
+
+  free(arrival);
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * File:
+ *    dmaPQueueBench.c
+ *
+ * Description:
+ *    Benchmark of the dmaPList partition queue modes (dmaPSetQueueMode).
+ *
+ *    Two threads ping-pong buffers the way the primary readout lists do:
+ *      trigger thread: dmaPGetItem(vmeIN)  -> fill -> dmaPAddItem(vmeOUT)
+ *      roc thread:     dmaPGetItem(vmeOUT) -> check -> dmaPFreeItem
+ *    and the rate (events/s) is reported for each mode.
+ *
+ *    Usage: dmaPQueueBench [number of events] [words per event]
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "jvme.h"
+
+#define BUFFER_SIZE 1024*10
+#define NBUFFER     400
+
+#define NEVENTS_DEFAULT 2000000
+#define NWORDS_DEFAULT  16
+
+DMA_MEM_ID vmeIN, vmeOUT;
+
+static int nevents = NEVENTS_DEFAULT, nwords = NWORDS_DEFAULT;
+static volatile int nerror = 0;
+
+static const char *modeName[] = { "LIST", "SPSC", "MPMC" };
+
+static double
+nowSec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1.e-9;
+}
+
+/* asyncTrigger: GETEVENT(vmeIN) ... PUTEVENT(vmeOUT) */
+static void *
+triggerThread(void *arg)
+{
+  DMANODE *node;
+  int iev, iword;
+
+  for(iev = 0; iev < nevents; iev++)
+    {
+      while((node = dmaPGetItem(vmeIN)) == 0)
+	sched_yield();
+
+      node->nevent = iev;
+      for(iword = 0; iword < nwords; iword++)
+	node->data[iword] = iev + iword;
+      node->length = nwords;
+
+      dmaPAddItem(vmeOUT, node);
+    }
+
+  return NULL;
+}
+
+/* usrtrig: dmaPGetItem(vmeOUT) ... dmaPFreeItem */
+static void *
+rocThread(void *arg)
+{
+  DMANODE *node;
+  int iev;
+
+  for(iev = 0; iev < nevents; iev++)
+    {
+      while((node = dmaPGetItem(vmeOUT)) == 0)
+	sched_yield();
+
+      if((node->nevent != iev) || (node->data[nwords-1] != iev + nwords - 1))
+	nerror++;
+
+      dmaPFreeItem(node);
+    }
+
+  return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+  pthread_t trig, roc;
+  double t0, dt;
+  int status, mode;
+
+  if(argc > 1)
+    nevents = atoi(argv[1]);
+  if(argc > 2)
+    nwords = atoi(argv[2]);
+  if((nwords < 1) || (nwords > BUFFER_SIZE/4))
+    nwords = NWORDS_DEFAULT;
+
+  printf("\ndmaPList queue mode benchmark: %d events, %d words/event\n",
+	 nevents, nwords);
+  printf("----------------------------\n");
+
+  status = vmeOpenDefaultWindows();
+  if(status != OK)
+    {
+      printf("vmeOpenDefaultWindows failed with code = 0x%x\n",status);
+      goto CLOSE;
+    }
+
+  vmeSetQuietFlag(1);
+
+  for(mode = DMAP_QUEUE_LIST; mode <= DMAP_QUEUE_MPMC; mode++)
+    {
+      dmaPFreeAll();
+      vmeIN  = dmaPCreate("vmeIN",BUFFER_SIZE,NBUFFER,0);
+      vmeOUT = dmaPCreate("vmeOUT",0,0,0);
+      if(vmeIN == 0)
+	{
+	  printf("Unable to allocate memory for event buffers\n");
+	  goto CLOSE;
+	}
+      dmaPReInitAll();
+      dmaPSetQueueMode(vmeIN, mode, NBUFFER);
+      dmaPSetQueueMode(vmeOUT, mode, NBUFFER);
+
+      nerror = 0;
+      t0 = nowSec();
+      pthread_create(&roc, NULL, rocThread, NULL);
+      pthread_create(&trig, NULL, triggerThread, NULL);
+      pthread_join(trig, NULL);
+      pthread_join(roc, NULL);
+      dt = nowSec() - t0;
+
+      printf("%s: %10.0f events/s  (%6.1f ns/event)  errors %d\n",
+	     modeName[mode], nevents/dt, dt/nevents*1.e9, nerror);
+      dmaPStatsAll();
+    }
+
+ CLOSE:
+  dmaPFreeAll();
+  vmeCloseDefaultWindows();
+
+  return 0;
+}
@@ -0,0 +1,295 @@
+/*
+ * File:
+ *    eventBatchBench.c
+ *
+ * Description:
+ *    Benchmark of the tiprimary_list.c trigger path with MAX_EVENT_BATCH.
+ *
+ *    Three threads stand in for the readout list and the ROC:
+ *      trigger: fills vmeIN buffers and puts them on vmeOUT (asyncTrigger)
+ *      roc:     polls vmeOUT and dispatches usrtrig the way
+ *               trigger_dispatch.h does (dispatch node, trigger_mutex,
+ *               WRITE_EVENT_, done routine).  usrtrig takes up to "batch"
+ *               events per call with dmaPGetItems/dmaPFreeItems.
+ *      output:  takes events off the output list, frees the pool buffers
+ *    The rate (events/s) is reported for small events and several batch
+ *    sizes.
+ *
+ *    Usage: eventBatchBench [number of events]
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "jvme.h"
+#include "mempart.h"
+
+#define MAX_EVENT_LENGTH 1024*10
+#define MAX_EVENT_POOL   400
+#define MAX_BATCH        64
+#define NEVENTS_DEFAULT  1000000
+
+DMA_MEM_ID vmeIN, vmeOUT;
+
+static DALIST pool, dispatch, dispQ, output;
+static pthread_mutex_t trigger_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t ack_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define LOCKINTS   pthread_mutex_lock(&trigger_mutex);
+#define UNLOCKINTS pthread_mutex_unlock(&trigger_mutex);
+
+static int nevents = NEVENTS_DEFAULT, nwords, batch;
+static volatile int nout, nrecv;
+static int rolNevents, doneCount;
+static DANODE *the_out_event;
+
+static double
+nowSec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1.e-9;
+}
+
+static DANODE *
+allocNode(int nbytes)
+{
+  DANODE *node = (DANODE *)calloc(1, sizeof(DANODE) + nbytes);
+  return node;
+}
+
+/* asyncTrigger */
+static void *
+triggerThread(void *arg)
+{
+  DMANODE *node;
+  int iev, iword;
+
+  for(iev = 0; iev < nevents; iev++)
+    {
+      while((node = dmaPGetItem(vmeIN)) == 0)
+	sched_yield();
+
+      for(iword = 0; iword < nwords; iword++)
+	node->data[iword] = iev + iword;
+      node->length = nwords;
+      node->type = 0;
+
+      dmaPAddItem(vmeOUT, node);
+    }
+
+  return NULL;
+}
+
+/* Copy a vmeOUT event into a pool buffer, behind a bank header */
+static DANODE *
+copyEvent(DMANODE *outEvent, DANODE *outNode, int nevent)
+{
+  if(outNode == 0)
+    return 0;
+
+  outNode->nevent  = nevent;
+  outNode->length  = outEvent->length + 1;
+  outNode->data[0] = (1<<16) | (0x10<<8) | 1;
+  memcpy((char *)&outNode->data[1], (char *)&outEvent->data[0],
+	 outEvent->length*sizeof(unsigned int));
+
+  return outNode;
+}
+
+/* usrtrig, as in tiprimary_list.c */
+static void
+usrtrig()
+{
+  DMANODE *outEvents[MAX_BATCH];
+  DANODE *outNodes[MAX_BATCH];
+  int iev, nev, maxev;
+
+  maxev = batch;
+  if(maxev > pool.c)
+    maxev = pool.c;
+  if(maxev < 1)
+    maxev = 1;
+
+  nev = dmaPGetItems(vmeOUT, outEvents, maxev);
+  if(nev == 0)
+    return;
+
+  /* pool buffers (the ROC output thread frees them) */
+  pthread_mutex_lock(&pool_mutex);
+  for(iev = 0; iev < nev; iev++)
+    listGet(&pool, outNodes[iev]);
+  pthread_mutex_unlock(&pool_mutex);
+
+  if(nev > 1)
+    {
+      for(iev = 0; iev < nev - 1; iev++)
+	outNodes[iev] = copyEvent(outEvents[iev], outNodes[iev], rolNevents + iev);
+
+      LOCKINTS;
+      for(iev = 0; iev < nev - 1; iev++)
+	{
+	  if(outNodes[iev])
+	    listAdd(&output, outNodes[iev]);
+	}
+      rolNevents += nev - 1;
+      UNLOCKINTS;
+    }
+
+  the_out_event = copyEvent(outEvents[nev - 1], outNodes[nev - 1], rolNevents);
+
+  pthread_mutex_lock(&ack_mutex);
+  dmaPFreeItems(outEvents, nev);
+  pthread_mutex_unlock(&ack_mutex);
+
+  nout += nev;
+}
+
+/* cdopolldispatch + cdodispatch + WRITE_EVENT_, for one trigger source */
+static void *
+rocThread(void *arg)
+{
+  DANODE *theNode;
+
+  while(nout < nevents)
+    {
+      if(dmaPEmpty(vmeOUT) || (pool.c == 0))
+	{
+	  sched_yield();
+	  continue;
+	}
+
+      LOCKINTS;
+      listGet(&dispatch, theNode);
+      listAdd(&dispQ, theNode);
+
+      listGet(&dispQ, theNode);
+      rolNevents++;
+      UNLOCKINTS;
+
+      usrtrig();
+
+      LOCKINTS;
+      listAdd(&dispatch, theNode);
+
+      /* WRITE_EVENT_ */
+      if(the_out_event)
+	listAdd(&output, the_out_event);
+      the_out_event = 0;
+      doneCount++;
+      UNLOCKINTS;
+    }
+
+  return NULL;
+}
+
+/* ROC output: ship events and free their pool buffers */
+static void *
+outputThread(void *arg)
+{
+  DANODE *theNode;
+
+  while(nrecv < nevents)
+    {
+      LOCKINTS;
+      while(output.c)
+	{
+	  listGet(&output, theNode);
+	  pthread_mutex_lock(&pool_mutex);
+	  listAdd(&pool, theNode);
+	  pthread_mutex_unlock(&pool_mutex);
+	  nrecv++;
+	}
+      UNLOCKINTS;
+      sched_yield();
+    }
+
+  return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int sizes[] = { 4, 16, 64 }, batches[] = { 1, 4, 16, 64 };
+  int isize, ibatch, inode;
+  pthread_t trig, roc, out;
+  double t0, dt, rate1 = 0;
+  int status;
+
+  if(argc > 1)
+    nevents = atoi(argv[1]);
+  if(nevents < 1)
+    nevents = NEVENTS_DEFAULT;
+
+  printf("\nEvent batch benchmark: %d events\n", nevents);
+  printf("----------------------------\n");
+
+  status = vmeOpenDefaultWindows();
+  if(status != OK)
+    {
+      printf("vmeOpenDefaultWindows failed with code = 0x%x\n",status);
+      goto CLOSE;
+    }
+  vmeSetQuietFlag(1);
+
+  dmaPFreeAll();
+  vmeIN  = dmaPCreate("vmeIN",MAX_EVENT_LENGTH,MAX_EVENT_POOL,0);
+  vmeOUT = dmaPCreate("vmeOUT",0,0,0);
+  if(vmeIN == 0)
+    {
+      printf("Unable to allocate memory for event buffers\n");
+      goto CLOSE;
+    }
+  dmaPReInitAll();
+
+  listInit(&pool);
+  listInit(&dispatch);
+  listInit(&dispQ);
+  listInit(&output);
+  for(inode = 0; inode < MAX_EVENT_POOL; inode++)
+    {
+      DANODE *node = allocNode(MAX_EVENT_LENGTH);
+      listAdd(&pool, node);
+    }
+  for(inode = 0; inode < 32; inode++)
+    {
+      DANODE *node = allocNode(0);
+      listAdd(&dispatch, node);
+    }
+
+  printf("%8s %8s %14s %10s\n", "words", "batch", "events/s", "vs batch 1");
+  for(isize = 0; isize < (int)(sizeof(sizes)/sizeof(int)); isize++)
+    {
+      nwords = sizes[isize];
+      for(ibatch = 0; ibatch < (int)(sizeof(batches)/sizeof(int)); ibatch++)
+	{
+	  batch = batches[ibatch];
+	  nout = nrecv = 0;
+
+	  t0 = nowSec();
+	  pthread_create(&out, NULL, outputThread, NULL);
+	  pthread_create(&roc, NULL, rocThread, NULL);
+	  pthread_create(&trig, NULL, triggerThread, NULL);
+	  pthread_join(trig, NULL);
+	  pthread_join(roc, NULL);
+	  pthread_join(out, NULL);
+	  dt = nowSec() - t0;
+
+	  if(batch == 1)
+	    rate1 = nevents / dt;
+	  printf("%8d %8d %14.0f %9.2fx\n",
+		 nwords, batch, nevents / dt, (nevents / dt) / rate1);
+	}
+    }
+
+ CLOSE:
+  dmaPFreeAll();
+  vmeCloseDefaultWindows();
+
+  return 0;
+}
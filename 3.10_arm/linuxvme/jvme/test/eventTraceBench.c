@@ -0,0 +1,173 @@
+/*
+ * File:
+ *    eventTraceBench.c
+ *
+ * Description:
+ *    Benchmark of the dmaPList event trace (dmaPTraceEnable).
+ *
+ *    Events go through the tiprimary_list.c stages in one thread:
+ *      asyncTrigger: GETEVENT(vmeIN), rocTrigger, PUTEVENT(vmeOUT)
+ *      usrtrig:      dmaPGetItem(vmeOUT), copy out, WRITE_EVENT_, dmaPFreeItem
+ *    once with tracing disabled and once enabled, and the difference in
+ *    time per event (the cost of the stamps and histograms) is reported,
+ *    along with the cost of the dmaPTraceTsc() calls alone (5 per event).
+ *    The stage histograms are then printed, and written to a file if
+ *    one is given.
+ *
+ *    Usage: eventTraceBench [number of events] [export file]
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#define DMAP_TRACE
+#include "jvme.h"
+
+#define BUFFER_SIZE 1024*10
+#define NBUFFER     400
+#define NWORDS      16
+
+#define NEVENTS_DEFAULT 2000000
+
+DMA_MEM_ID vmeIN, vmeOUT;
+extern DMANODE *the_event;
+extern unsigned int *dma_dabufp;
+
+static unsigned int outBuffer[BUFFER_SIZE/4];
+
+static double
+nowSec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1.e-9;
+}
+
+/* Time per dmaPTraceTsc() call (ns) */
+static double
+rdtscCost(int ncalls)
+{
+  volatile unsigned long long tsc;
+  double t0;
+  int icall;
+
+  t0 = nowSec();
+  for(icall = 0; icall < ncalls; icall++)
+    tsc = dmaPTraceTsc();
+  (void)tsc;
+
+  return (nowSec() - t0) / ncalls * 1.e9;
+}
+
+/* Run nevents through the stages, return the time per event (ns) */
+static double
+runEvents(int nevents)
+{
+  DMANODE *outEvent;
+  unsigned long long triggerTime;
+  double t0;
+  int iev, iword;
+
+  t0 = nowSec();
+  for(iev = 0; iev < nevents; iev++)
+    {
+      /* asyncTrigger */
+      triggerTime = 0;
+      if(dmaPTraceFlag)
+	triggerTime = dmaPTraceTsc();
+
+      GETEVENT(vmeIN, iev);
+      if(dmaPTraceFlag)
+	dmaPTraceStamps(the_event)[DMAP_TRACE_TRIGGER] = triggerTime;
+      dmaPTraceStamp(the_event, DMAP_TRACE_READOUT);
+
+      for(iword = 0; iword < NWORDS; iword++)
+	*dma_dabufp++ = iev + iword;
+
+      PUTEVENT(vmeOUT);
+
+      /* usrtrig */
+      outEvent = dmaPGetItem(vmeOUT);
+      dmaPTraceStamp(outEvent, DMAP_TRACE_USRTRIG);
+
+      memcpy((char *)outBuffer, (char *)outEvent->data,
+	     outEvent->length*sizeof(unsigned int));
+
+      /* WRITE_EVENT_ */
+      if(dmaPTraceFlag)
+	{
+	  dmaPTraceStamp(outEvent, DMAP_TRACE_WRITE);
+	  dmaPTraceRecord(dmaPTraceStamps(outEvent));
+	}
+
+      dmaPFreeItem(outEvent);
+    }
+
+  return (nowSec() - t0) / nevents * 1.e9;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nevents = NEVENTS_DEFAULT;
+  double nsOff, nsOn, nsTsc;
+  int status;
+
+  if(argc > 1)
+    nevents = atoi(argv[1]);
+  if(nevents < 1)
+    nevents = NEVENTS_DEFAULT;
+
+  printf("\nEvent trace benchmark: %d events, %d words/event\n",
+	 nevents, NWORDS);
+  printf("----------------------------\n");
+
+  status = vmeOpenDefaultWindows();
+  if(status != OK)
+    {
+      printf("vmeOpenDefaultWindows failed with code = 0x%x\n",status);
+      goto CLOSE;
+    }
+  vmeSetQuietFlag(1);
+
+  dmaPFreeAll();
+  vmeIN  = dmaPCreate("vmeIN",BUFFER_SIZE,NBUFFER,0);
+  vmeOUT = dmaPCreate("vmeOUT",0,0,0);
+  if(vmeIN == 0)
+    {
+      printf("Unable to allocate memory for event buffers\n");
+      goto CLOSE;
+    }
+  dmaPReInitAll();
+
+  /* warm up */
+  runEvents(nevents / 10 + 1);
+
+  dmaPTraceEnable(0);
+  nsOff = runEvents(nevents);
+
+  dmaPTraceEnable(1);
+  nsOn = runEvents(nevents);
+
+  printf("trace off: %8.1f ns/event\n", nsOff);
+  printf("trace on:  %8.1f ns/event\n", nsOn);
+  printf("overhead:  %8.1f ns/event\n", nsOn - nsOff);
+  nsTsc = rdtscCost(nevents);
+  printf("  of which dmaPTraceTsc() %.1f ns x %d stamps\n\n", nsTsc, DMAP_TRACE_NSTAGE);
+
+  dmaPTraceStats();
+
+  if(argc > 2)
+    {
+      if(dmaPTraceExport(argv[2]) == OK)
+	printf("\nHistograms written to %s\n", argv[2]);
+    }
+
+ CLOSE:
+  dmaPFreeAll();
+  vmeCloseDefaultWindows();
+
+  return 0;
+}
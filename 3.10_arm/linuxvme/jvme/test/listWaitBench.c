@@ -0,0 +1,221 @@
+/*
+ * File:
+ *    listWaitBench.c
+ *
+ * Description:
+ *    Benchmark of dmalistWait (dmaPList.h) and listWait (mempart.h).
+ *
+ *    For each list type, and for the old busy spin for comparison:
+ *      - wake latency: time from the producer's list add to the
+ *        consumer's return from the wait, for producer gaps of 0-500 us
+ *      - idle CPU: CPU time used by a consumer waiting 1 s on an
+ *        empty list (ended with the timeout flag)
+ *
+ *    listWait is built with LIST_WAIT_FUTEX: the list is filled here.
+ *    No VME hardware is needed.
+ *
+ *    Usage: listWaitBench [number of events]
+ *
+ */
+
+#define _GNU_SOURCE
+#define LIST_WAIT_FUTEX
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "jvme.h"
+#include "mempart.h"
+
+#define NEVENTS_DEFAULT  2000
+#define MAX_GAP_US       500     /* longest producer gap between events */
+
+enum { WAIT_DMALIST, WAIT_DALIST, WAIT_SPIN, NWAIT };
+static const char *waitName[NWAIT] = { "dmalistWait", "listWait", "busy spin" };
+
+static int waitMode = WAIT_DMALIST, nevents = NEVENTS_DEFAULT;
+
+static DMALIST dmaList;
+static DALIST  daList;
+static DMANODE dmaNode;
+static DANODE  daNode;
+
+static volatile double tAdd;       /* producer time of the last add (ns) */
+static volatile int    taken = 0;  /* consumer has the last node */
+static double *latency;            /* per event wake latency (ns) */
+static double idleCpu;             /* consumer CPU used while idle (s) */
+
+static double
+nowNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec*1.e9 + (double)ts.tv_nsec;
+}
+
+static double
+threadCpu()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_THREAD, &ru);
+  return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+    (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec)*1.e-6;
+}
+
+/* Wait for a node on the list of the current mode.  Returns 0 on timeout. */
+static int
+waitNode()
+{
+  DMANODE *dmaNo;
+  DANODE *daNo;
+
+  switch(waitMode)
+    {
+    case WAIT_DMALIST:
+      dmalistWait(&dmaList, dmaNo);
+      return (dmaNo != (void *) -1);
+
+    case WAIT_DALIST:
+      listWait(&daList, daNo);
+      return (daNo != (void *) -1);
+
+    default:
+      /* What dmalistWait did before: spin on the count */
+      dmaList.to = 0;
+      while((*(volatile long *)&dmaList.c == 0) &&
+	    (*(volatile int *)&dmaList.to == 0))
+	;
+      if(dmaList.to)
+	return 0;
+      dmalistGet(&dmaList, dmaNo);
+      return 1;
+    }
+}
+
+static void
+addNode()
+{
+  tAdd = nowNs();
+  if(waitMode == WAIT_DALIST)
+    {
+      listAdd(&daList, &daNode);
+    }
+  else
+    {
+      dmalistAdd(&dmaList, &dmaNode);
+    }
+}
+
+static void
+timeoutList()
+{
+  if(waitMode == WAIT_DALIST)
+    {
+      listTimeout(&daList);
+    }
+  else
+    {
+      dmalistTimeout(&dmaList);
+    }
+}
+
+static void *
+consumer(void *arg)
+{
+  double cpu0;
+  int iev;
+
+  for(iev = 0; iev < nevents; iev++)
+    {
+      if(!waitNode())
+	break;
+      latency[iev] = nowNs() - tAdd;
+      taken = 1;
+    }
+
+  cpu0 = threadCpu();
+  waitNode();  /* empty list, until timeoutList */
+  idleCpu = threadCpu() - cpu0;
+
+  return NULL;
+}
+
+static int
+compareDouble(const void *a, const void *b)
+{
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static void
+runBench()
+{
+  pthread_t thread;
+  double sum = 0;
+  int iev;
+
+  dmalistInit(&dmaList);
+  listInit(&daList);
+  taken = 0;
+
+  pthread_create(&thread, NULL, consumer, NULL);
+
+  for(iev = 0; iev < nevents; iev++)
+    {
+      usleep(rand() % (MAX_GAP_US + 1));
+      taken = 0;
+      addNode();
+      while(!taken)
+	usleep(1);
+    }
+
+  sleep(1);
+  timeoutList();
+  pthread_join(thread, NULL);
+
+  for(iev = 0; iev < nevents; iev++)
+    sum += latency[iev];
+  qsort(latency, nevents, sizeof(double), compareDouble);
+
+  printf("%-12s %10.2f %10.2f %10.2f %10.2f %12.3f\n",
+	 waitName[waitMode],
+	 sum / nevents * 1.e-3,
+	 latency[nevents/2] * 1.e-3,
+	 latency[(int)(nevents*0.99)] * 1.e-3,
+	 latency[nevents-1] * 1.e-3,
+	 idleCpu);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc > 1)
+    nevents = atoi(argv[1]);
+  if(nevents < 1)
+    nevents = NEVENTS_DEFAULT;
+
+  latency = (double *)malloc(nevents * sizeof(double));
+  if(latency == NULL)
+    {
+      perror("malloc");
+      return -1;
+    }
+
+  printf("\nlistWait benchmark: %d events, producer gap 0-%d us\n",
+	 nevents, MAX_GAP_US);
+  printf("----------------------------\n");
+  printf("%-12s %10s %10s %10s %10s %12s\n",
+	 "wait", "mean(us)", "median(us)", "99%(us)", "max(us)", "idle cpu(s)");
+
+  for(waitMode = 0; waitMode < NWAIT; waitMode++)
+    runBench();
+
+  free(latency);
+
+  return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * File:
+ *    packedPartBench.c
+ *
+ * Description:
+ *    Benchmark of the packed partition (dmaPCreatePacked) against a
+ *    partition of fixed size buffers (dmaPCreate), with the same memory.
+ *
+ *    Both hold events of up to MAX_EVENT_LENGTH bytes, in BUDGET bytes.
+ *    For each event size distribution:
+ *      depth: events are read out (GETEVENT, PUTEVENT on vmeOUT) and not
+ *             freed, until vmeIN is empty.  The number buffered is reported.
+ *      rate:  events are read out, and freed in order from vmeOUT when
+ *             vmeIN is empty (usrtrig).  The time per event is reported.
+ *    Every event is checked when it is freed.
+ *
+ *    Usage: packedPartBench [number of events]
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "jvme.h"
+
+#define MAX_EVENT_LENGTH 1024*10
+#define BUDGET           0x400000  /* bytes */
+
+#define NEVENTS_DEFAULT  2000000
+
+DMA_MEM_ID vmeIN, vmeOUT;
+extern DMANODE *the_event;
+extern unsigned int *dma_dabufp;
+
+static int nerror;
+
+static double
+nowSec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1.e-9;
+}
+
+/* Event sizes (words) */
+static int
+fixed256(int iev)
+{
+  return 256/4;
+}
+
+static int
+fixed1k(int iev)
+{
+  return 1024/4;
+}
+
+/* Mostly 200-600 bytes, 1 in 10 from 2 to 10 kB */
+static int
+mixed(int iev)
+{
+  if((rand() % 10) == 0)
+    return (2048 + rand() % (MAX_EVENT_LENGTH - 2048)) / 4;
+  return (200 + rand() % 400) / 4;
+}
+
+/* Read out one event of nwords onto vmeOUT.  ERROR if vmeIN is empty */
+static int
+readEvent(int iev, int nwords)
+{
+  int iword;
+
+  GETEVENT(vmeIN, iev);
+  if(the_event == 0)
+    return ERROR;
+
+  *dma_dabufp++ = iev;
+  for(iword = 1; iword < nwords - 1; iword++)
+    *dma_dabufp++ = iword;
+  *dma_dabufp++ = ~iev;
+
+  PUTEVENT(vmeOUT);
+
+  return OK;
+}
+
+/* Check and free the oldest vmeOUT event.  ERROR if there is none */
+static int
+freeEvent()
+{
+  DMANODE *outEvent;
+
+  outEvent = dmaPGetItem(vmeOUT);
+  if(outEvent == 0)
+    return ERROR;
+
+  if((outEvent->data[0] != (unsigned int)outEvent->nevent) ||
+     (outEvent->data[outEvent->length - 1] != ~(unsigned int)outEvent->nevent))
+    nerror++;
+
+  dmaPFreeItem(outEvent);
+
+  return OK;
+}
+
+/* Number of events buffered before vmeIN is empty */
+static int
+runDepth(int (*size)(int))
+{
+  int depth = 0;
+
+  srand(1);
+  while(!dmaPEmpty(vmeIN) && (readEvent(depth, size(depth)) == OK))
+    depth++;
+
+  while(freeEvent() == OK);
+
+  return depth;
+}
+
+/* Time per event (ns) */
+static double
+runRate(int (*size)(int), int nevents)
+{
+  double t0;
+  int iev;
+
+  srand(1);
+  t0 = nowSec();
+  for(iev = 0; iev < nevents; iev++)
+    {
+      while(dmaPEmpty(vmeIN))
+	freeEvent();
+      readEvent(iev, size(iev));
+    }
+  while(freeEvent() == OK);
+
+  return (nowSec() - t0) / nevents * 1.e9;
+}
+
+/* Reserve items and free them out of order.  Returns the number of
+   largest items there is room for after. */
+static int
+runOutOfOrder()
+{
+  DMANODE *items[8];
+  int iitem;
+
+  for(iitem = 0; iitem < 8; iitem++)
+    {
+      items[iitem] = dmaPGetItem(vmeIN);
+      items[iitem]->length = 16;
+      dmaPAddItem(vmeOUT, items[iitem]);
+      dmaPGetItem(vmeOUT);
+    }
+
+  for(iitem = 7; iitem >= 0; iitem -= 2)
+    dmaPFreeItem(items[iitem]);
+  for(iitem = 0; iitem < 8; iitem += 2)
+    dmaPFreeItem(items[iitem]);
+
+  return dmaPNodeCount(vmeIN);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct
+  {
+    const char *name;
+    int (*size)(int);
+  } dists[] = { { "256 B", fixed256 }, { "1 kB", fixed1k }, { "mixed", mixed } };
+  int nevents = NEVENTS_DEFAULT, idist, packed, nlist = 0, depth, nfree;
+  double ns;
+  int status;
+
+  if(argc > 1)
+    nevents = atoi(argv[1]);
+  if(nevents < 1)
+    nevents = NEVENTS_DEFAULT;
+
+  printf("\nPacked partition benchmark: %d events, %d kB of event buffers\n",
+	 nevents, BUDGET/1024);
+  printf("----------------------------\n");
+
+  status = vmeOpenDefaultWindows();
+  if(status != OK)
+    {
+      printf("vmeOpenDefaultWindows failed with code = 0x%x\n",status);
+      goto CLOSE;
+    }
+  vmeSetQuietFlag(1);
+
+  /* As many fixed size buffers as fit in BUDGET */
+  dmaPFreeAll();
+  vmeIN = dmaPCreate("vmeIN",MAX_EVENT_LENGTH,1,0);
+  if(vmeIN == 0)
+    {
+      printf("Unable to allocate memory for event buffers\n");
+      goto CLOSE;
+    }
+  nlist = BUDGET / vmeIN->size;
+
+  printf("%8s %8s %8s %12s %8s\n", "events", "vmeIN", "depth", "ns/event", "errors");
+  for(idist = 0; idist < (int)(sizeof(dists)/sizeof(dists[0])); idist++)
+    {
+      for(packed = 0; packed <= 1; packed++)
+	{
+	  dmaPFreeAll();
+	  if(packed)
+	    vmeIN = dmaPCreatePacked("vmeIN",MAX_EVENT_LENGTH,BUDGET);
+	  else
+	    vmeIN = dmaPCreate("vmeIN",MAX_EVENT_LENGTH,nlist,0);
+	  vmeOUT = dmaPCreate("vmeOUT",0,0,0);
+	  if(vmeIN == 0)
+	    {
+	      printf("Unable to allocate memory for event buffers\n");
+	      goto CLOSE;
+	    }
+	  dmaPReInitAll();
+
+	  nerror = 0;
+	  depth = runDepth(dists[idist].size);
+	  ns = runRate(dists[idist].size, nevents);
+
+	  printf("%8s %8s %8d %12.1f %8d\n",
+		 dists[idist].name, packed ? "packed" : "fixed", depth, ns, nerror);
+	}
+    }
+
+  nfree = runOutOfOrder();
+  printf("\nOut of order free: room for %d of %d largest events after (%s)\n",
+	 nfree, nlist, (nfree == nlist) ? "ok" : "ERROR");
+
+  dmaPStatsAll();
+
+ CLOSE:
+  dmaPFreeAll();
+  vmeCloseDefaultWindows();
+
+  return 0;
+}
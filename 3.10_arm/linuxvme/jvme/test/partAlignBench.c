@@ -0,0 +1,195 @@
+/*
+ * File:
+ *    partAlignBench.c
+ *
+ * Description:
+ *    Benchmark of the dmaPList item data alignment (dmaPSetAlignment).
+ *
+ *    Two partitions (vmeIN and a copy of the ROC pool) are created with
+ *    each alignment, and events of several sizes are run through all of
+ *    their items in turn, so that the data does not stay in the cache:
+ *      dma:  the event is written in 64 bit words, as the DMA engine
+ *            writes it, and then read once (rocTrigger)
+ *      copy: the event is copied to the second partition (usrtrig)
+ *    The throughput (MB/s) of each is reported, with the item size and
+ *    the number of items whose data does not start on a cache line.
+ *
+ *    Usage: partAlignBench [number of passes]
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "jvme.h"
+
+#define BUFFER_SIZE 1024*10
+#define NBUFFER     400
+
+#define NPASS_DEFAULT 200
+
+static double
+nowSec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1.e-9;
+}
+
+/* Items of a partition, in list order */
+static int
+getItems(DMA_MEM_ID pPart, DMANODE **items)
+{
+  int nitems = 0;
+
+  while((items[nitems] = dmaPGetItem(pPart)) != 0)
+    nitems++;
+
+  return nitems;
+}
+
+/* Number of items with data not aligned to align bytes */
+static int
+countMisaligned(DMANODE **items, int nitems, int align)
+{
+  int iitem, nbad = 0;
+
+  for(iitem = 0; iitem < nitems; iitem++)
+    {
+      if((unsigned long)&items[iitem]->data[0] & (align - 1))
+	nbad++;
+    }
+
+  return nbad;
+}
+
+/* DMA: write each event in 64 bit words, then read it.  Returns MB/s */
+static double
+runDma(DMANODE **items, int nitems, int nbytes, int npass)
+{
+  volatile unsigned long long sum = 0;
+  unsigned long long *p, s;
+  double t0;
+  int ipass, iitem, iword, nwords = nbytes / 8;
+
+  t0 = nowSec();
+  for(ipass = 0; ipass < npass; ipass++)
+    {
+      for(iitem = 0; iitem < nitems; iitem++)
+	{
+	  p = (unsigned long long *)&items[iitem]->data[0];
+	  for(iword = 0; iword < nwords; iword++)
+	    p[iword] = ((unsigned long long)ipass << 32) | iword;
+	  __asm__ __volatile__("" ::: "memory");
+
+	  s = 0;
+	  for(iword = 0; iword < nwords; iword++)
+	    s += p[iword];
+	  sum += s;
+	  items[iitem]->length = nbytes / sizeof(unsigned int);
+	}
+    }
+
+  return (double)npass * nitems * nbytes / (nowSec() - t0) / 1.e6;
+}
+
+/* Copy: each event to the item of the second partition.  Returns MB/s */
+static double
+runCopy(DMANODE **src, DMANODE **dst, int nitems, int nbytes, int npass)
+{
+  double t0;
+  int ipass, iitem;
+
+  t0 = nowSec();
+  for(ipass = 0; ipass < npass; ipass++)
+    {
+      for(iitem = 0; iitem < nitems; iitem++)
+	{
+	  memcpy((char *)&dst[iitem]->data[0], (char *)&src[iitem]->data[0], nbytes);
+	  dst[iitem]->length = src[iitem]->length;
+	}
+    }
+
+  return (double)npass * nitems * nbytes / (nowSec() - t0) / 1.e6;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int aligns[] = { DMAP_ALIGN_DEFAULT, DMAP_ALIGN_CACHE_LINE, DMAP_ALIGN_MAX };
+  int sizes[] = { 64, 256, 1024, 8192 };
+  int ialign, isize, iitem, nsrc, ndst, npass = NPASS_DEFAULT, nbad;
+  DMA_MEM_ID vmeIN, pool;
+  static DMANODE *src[NBUFFER + 1], *dst[NBUFFER + 1];
+  double mbDma, mbCopy;
+  int status;
+
+  if(argc > 1)
+    npass = atoi(argv[1]);
+  if(npass < 1)
+    npass = NPASS_DEFAULT;
+
+  printf("\nPartition alignment benchmark: %d items, %d passes\n",
+	 NBUFFER, npass);
+  printf("----------------------------\n");
+
+  status = vmeOpenDefaultWindows();
+  if(status != OK)
+    {
+      printf("vmeOpenDefaultWindows failed with code = 0x%x\n",status);
+      goto CLOSE;
+    }
+  vmeSetQuietFlag(1);
+
+  printf("%6s %9s %9s %8s %12s %12s\n",
+	 "align", "itembytes", "unaligned", "bytes", "dma(MB/s)", "copy(MB/s)");
+  for(ialign = 0; ialign < (int)(sizeof(aligns)/sizeof(int)); ialign++)
+    {
+      dmaPFreeAll();
+      if(dmaPSetAlignment(aligns[ialign]) != OK)
+	goto CLOSE;
+      vmeIN = dmaPCreate("vmeIN",BUFFER_SIZE,NBUFFER,0);
+      pool  = dmaPCreate("pool",BUFFER_SIZE,NBUFFER,0);
+      dmaPSetAlignment(DMAP_ALIGN_DEFAULT);
+      if((vmeIN == 0) || (pool == 0))
+	{
+	  printf("Unable to allocate memory for event buffers\n");
+	  goto CLOSE;
+	}
+      dmaPReInitAll();
+
+      nsrc = getItems(vmeIN, src);
+      ndst = getItems(pool, dst);
+      if(nsrc != ndst)
+	{
+	  printf("ERROR: %d vmeIN items, %d pool items\n", nsrc, ndst);
+	  goto CLOSE;
+	}
+      nbad = countMisaligned(src, nsrc, DMAP_ALIGN_CACHE_LINE) +
+	countMisaligned(dst, ndst, DMAP_ALIGN_CACHE_LINE);
+
+      /* warm up */
+      runDma(src, nsrc, sizes[0], 1);
+
+      for(isize = 0; isize < (int)(sizeof(sizes)/sizeof(int)); isize++)
+	{
+	  mbDma  = runDma(src, nsrc, sizes[isize], npass);
+	  mbCopy = runCopy(src, dst, nsrc, sizes[isize], npass);
+	  printf("%6d %9d %9d %8d %12.0f %12.0f\n",
+		 aligns[ialign], vmeIN->size, nbad, sizes[isize], mbDma, mbCopy);
+	}
+
+      for(iitem = 0; iitem < nsrc; iitem++)
+	{
+	  dmaPFreeItem(src[iitem]);
+	  dmaPFreeItem(dst[iitem]);
+	}
+    }
+
+ CLOSE:
+  dmaPFreeAll();
+  vmeCloseDefaultWindows();
+
+  return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * File:
+ *    zeroCopyBench.c
+ *
+ * Description:
+ *    Benchmark of the tiprimary_list.c event hand-off from vmeOUT to the
+ *    ROC output, with and without ZERO_COPY_OUTPUT.
+ *
+ *    A software trigger thread fills vmeIN buffers (asyncTrigger) and
+ *    puts them on vmeOUT.  The ROC thread (usrtrig) gets them and either
+ *      copy: copies the event into an output buffer behind a bank header
+ *            (CEOPEN/CECLOSE), and frees the vmeOUT buffer
+ *      zero-copy: writes the node's partition, the ROC node and the bank
+ *            header into the buffer's headroom and passes the buffer on
+ *    The output is then "shipped" (every word read once) and freed, as
+ *    the ROC does after sending an event (partFreeItem, whose free_cmd
+ *    returns a zero-copy buffer to vmeIN).
+ *
+ *    Usage: zeroCopyBench [number of events]
+ *
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "jvme.h"
+#include "mempart.h"
+
+#define MAX_EVENT_LENGTH 1024*40
+#define MAX_EVENT_POOL   100
+#define NEVENTS_DEFAULT  200000
+
+/* As in tiprimary_list.c */
+#define EVENT_ALIGN DMAP_ALIGN_DEFAULT
+#if defined(__SIZEOF_POINTER__) && (__SIZEOF_POINTER__ > 4)
+#define ZC_HEADROOM							\
+  ((((sizeof(ROL_MEM_PART) + offsetof(DANODE, data)) + EVENT_ALIGN - 1)	\
+    / EVENT_ALIGN) * (EVENT_ALIGN / sizeof(unsigned int)) + 1)
+#else
+#define ZC_HEADROOM							\
+  ((((sizeof(ROL_MEM_PART) + offsetof(DANODE, data) + sizeof(unsigned int)) \
+     + EVENT_ALIGN - 1) / EVENT_ALIGN) * (EVENT_ALIGN / sizeof(unsigned int)))
+#endif
+#define ZC_OUTPART(dmaNode) ((ROL_MEM_ID)&(dmaNode)->data[0])
+#define ZC_OUTNODE(dmaNode)						\
+  ((DANODE *)((char *)&(dmaNode)->data[ZC_HEADROOM - 1] - offsetof(DANODE, data)))
+
+DMA_MEM_ID vmeIN, vmeOUT;
+
+static int nevents = NEVENTS_DEFAULT, nwords, zeroCopy;
+static DANODE *copyNode;               /* output buffer for the copy path */
+static volatile unsigned int checksum;
+
+static double
+nowSec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1.e-9;
+}
+
+/* asyncTrigger */
+static void *
+triggerThread(void *arg)
+{
+  DMANODE *node;
+  unsigned int *dabufp;
+  int iev, iword;
+
+  for(iev = 0; iev < nevents; iev++)
+    {
+      while((node = dmaPGetItem(vmeIN)) == 0)
+	sched_yield();
+
+      dabufp = &node->data[ZC_HEADROOM];
+      for(iword = 0; iword < nwords; iword++)
+	*dabufp++ = iev + iword;
+      node->length = dabufp - &node->data[0];
+      node->nevent = iev;
+
+      dmaPAddItem(vmeOUT, node);
+    }
+
+  return NULL;
+}
+
+/* free_cmd of a zero-copy node's partition */
+static void
+zcFreeEvent(DMANODE *outEvent)
+{
+  dmaPFreeItem(outEvent);
+}
+
+/* What the ROC does with an output event: send it, then free it */
+static void
+shipEvent(DANODE *outNode)
+{
+  unsigned int sum = 0, *word = &outNode->length;
+  int iword, len = outNode->length + 1;
+
+  for(iword = 0; iword < len; iword++)
+    sum += word[iword];
+  checksum += sum;
+
+  if(zeroCopy)
+    partFreeItem(outNode);
+}
+
+/* usrtrig */
+static void *
+rocThread(void *arg)
+{
+  DMANODE *outEvent;
+  ROL_MEM_ID outPart;
+  DANODE *outNode;
+  unsigned int *dabufp;
+  int iev, ii, len;
+
+  for(iev = 0; iev < nevents; iev++)
+    {
+      while((outEvent = dmaPGetItem(vmeOUT)) == 0)
+	sched_yield();
+
+      len = outEvent->length - ZC_HEADROOM;
+
+      if(zeroCopy)
+	{
+	  outPart = ZC_OUTPART(outEvent);
+	  memset((char *)outPart, 0, sizeof(ROL_MEM_PART));
+	  outPart->free_cmd   = zcFreeEvent;
+	  outPart->clientData = outEvent;
+
+	  outNode = ZC_OUTNODE(outEvent);
+	  memset((char *)outNode, 0, offsetof(DANODE, length));
+	  outNode->part    = outPart;
+	  outNode->nevent  = outEvent->nevent;
+	  outNode->length  = len + 1;
+	  outNode->data[0] = (1 << 16) | (0x10 << 8) | 1;
+	}
+      else
+	{
+	  outNode = copyNode;
+	  outNode->nevent  = outEvent->nevent;
+	  outNode->length  = len + 1;
+	  outNode->data[0] = (1 << 16) | (0x10 << 8) | 1;
+	  dabufp = &outNode->data[1];
+	  for(ii = 0; ii < len; ii++)
+	    *dabufp++ = outEvent->data[ZC_HEADROOM + ii];
+
+	  dmaPFreeItem(outEvent);
+	}
+
+      shipEvent(outNode);
+    }
+
+  return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int sizes[] = { 16, 256, 2048, 8192 }, isize;
+  pthread_t trig, roc;
+  double t0, dt;
+  int status;
+
+  if(argc > 1)
+    nevents = atoi(argv[1]);
+  if(nevents < 1)
+    nevents = NEVENTS_DEFAULT;
+
+  printf("\nZero-copy output benchmark: %d events\n", nevents);
+  printf("----------------------------\n");
+
+  status = vmeOpenDefaultWindows();
+  if(status != OK)
+    {
+      printf("vmeOpenDefaultWindows failed with code = 0x%x\n",status);
+      goto CLOSE;
+    }
+  vmeSetQuietFlag(1);
+
+  dmaPFreeAll();
+  dmaPSetAlignment(EVENT_ALIGN);
+  vmeIN  = dmaPCreate("vmeIN",MAX_EVENT_LENGTH + ZC_HEADROOM*sizeof(unsigned int),
+		      MAX_EVENT_POOL,0);
+  vmeOUT = dmaPCreate("vmeOUT",0,0,0);
+  if(vmeIN == 0)
+    {
+      printf("Unable to allocate memory for event buffers\n");
+      goto CLOSE;
+    }
+  dmaPReInitAll();
+
+  copyNode = (DANODE *)malloc(sizeof(DANODE) + MAX_EVENT_LENGTH);
+
+  printf("%8s %14s %14s %10s\n", "words", "copy (ev/s)", "zero-copy", "speedup");
+  for(isize = 0; isize < (int)(sizeof(sizes)/sizeof(int)); isize++)
+    {
+      double rate[2];
+
+      nwords = sizes[isize];
+      for(zeroCopy = 0; zeroCopy < 2; zeroCopy++)
+	{
+	  t0 = nowSec();
+	  pthread_create(&roc, NULL, rocThread, NULL);
+	  pthread_create(&trig, NULL, triggerThread, NULL);
+	  pthread_join(trig, NULL);
+	  pthread_join(roc, NULL);
+	  dt = nowSec() - t0;
+	  rate[zeroCopy] = nevents / dt;
+	}
+
+      printf("%8d %14.0f %14.0f %9.2fx\n",
+	     nwords, rate[0], rate[1], rate[1]/rate[0]);
+    }
+
+  free(copyNode);
+
+ CLOSE:
+  dmaPFreeAll();
+  vmeCloseDefaultWindows();
+
+  return 0;
+}